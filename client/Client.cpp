@@ -26,7 +26,6 @@
 #include <fstream>
 #include <sstream>
 
-#include <boost/unordered_map.hpp>
 
 #include <common/Protocol.hpp>
 #include <crossbow/logger.hpp>
@@ -37,107 +36,71 @@ using err_code = boost::system::error_code;
 
 namespace tpch {
 
-Client::Client(boost::asio::io_service& service,
-        const uint updateBatchSize)
-    : mSocket(service)
-    , mCmds(mSocket)
+Client::Client(std::unique_ptr<Stream> stream,
+        const uint updateBatchSize, const uint pipelineDepth, const bool compactWire, Compressor* compressor,
+        const bool byReference)
+    : mStream(std::move(stream))
+    , mCmds(*mStream)
+    , mUpdateFile(0)
     , mCurrentStartIdx(0)
     , mDoInsert(true)
     , mUpdateBatchSize(updateBatchSize)
     , mBatchCounter(0)
-    , mIsLast(false)
+    , mPipelineDepth(std::max(pipelineDepth, 1u))
+    , mCompactWire(compactWire)
+    , mCompressor(compressor)
+    , mByReference(byReference)
+    , mInFlight(0)
+    , mBatchSuccess(true)
+    , mBatchConflict(false)
+    , mBatchAttempts(0)
     , mBatchStartTime(Clock::now())
     , mEndTime(Clock::now())
 {}
 
 template <Command C>
-void Client::execute(const typename Signature<C>::arguments &arg) {
-    if (mBatchStartTime > mEndTime) {
-        // Time's up
-        // benchmarking finished
-        mSocket.shutdown(Socket::shutdown_both);
-        mSocket.close();
-        return;
-    }
+void Client::execute(typename Signature<C>::arguments arg) {
+    ++mInFlight;
     mCmds.execute<C>(
       [this](const err_code &ec, typename Signature<C>::result result) {
+          --mInFlight;
           if (ec) {
               LOG_ERROR("Error: " + ec.message());
               return;
           }
           if (!result.success) {
               LOG_ERROR("Transaction unsuccessful [error = %1%]", result.error);
+              if (mBatchSuccess)
+                  mBatchError = result.error;
+              mBatchSuccess = false;
           }
           LOG_DEBUG("Affected rows: %1%", result.affectedRows);
-          if (mIsLast) {
+          mBatchConflict = mBatchConflict || result.conflict;
+          mBatchAttempts += result.attempts;
+          if (mBatchCounter == mUpdateBatchSize && mInFlight == 0) {
+              // the RF2 of a batch deletes the orders its RF1 inserted, so
+              // the next batch waits for all sub-batches of this one
               mBatchCounter = 0;
               mDoInsert = !mDoInsert;
               auto end = Clock::now();
-                  mLog.push_back(LogEntry{result.success, result.error, C, mBatchStartTime, end});
-              }
-              run();
-          },
-          arg);
-    }
+              // a batch sent by reference is still an RF1 for the results
+              auto transaction = C == Command::RF1_REF ? Command::RF1 : C;
+              mLog.push_back(LogEntry{mBatchSuccess, mBatchConflict, mBatchAttempts, mBatchError, transaction,
+                      mBatchStartTime, end});
+          }
+          run();
+      },
+      std::move(arg));
+}
 
     void Client::prepare(const std::string &baseDir, const uint updateFileIndex) {
-        // open order file
-        std::string fName = baseDir + "/" + orderFilePrefix + std::to_string(updateFileIndex+1);
-        if (!file_readable(fName))
-            LOG_ERROR("Error: file " + fName + " does not exist!");
-        std::fstream orderIn(fName.c_str(), std::ios_base::in);
-
-        fName = baseDir + "/" + lineitemFilePrefix + std::to_string(updateFileIndex+1);
-        if (!file_readable(fName))
-            LOG_ERROR("Error: file " + fName + " does not exist!");
-        std::fstream lineItemIn(fName.c_str(), std::ios_base::in);
-
-        // create order tuples
-        using order_t = std::tuple<int32_t, int32_t, crossbow::string, double, date, crossbow::string, crossbow::string, int32_t, crossbow::string>;
-        boost::unordered_map<int32_t, size_t> orderIdToIdx;
-        getFields<order_t>(orderIn, [&] (const order_t& fields) {
-            mOrders.emplace_back();
-            Order &order = mOrders.back();
-            order.orderkey = std::get<0>(fields);
-            order.custkey = std::get<1>(fields);
-            order.orderstatus = std::get<2>(fields);
-            order.totalprice = std::get<3>(fields);
-            order.orderdate = std::get<4>(fields).value;
-            order.orderpriority = std::get<5>(fields);
-            order.clerk = std::get<6>(fields);
-            order.shippriority = std::get<7>(fields);
-            order.comment = std::get<8>(fields);
-            order.lineitems.reserve(7);
-            orderIdToIdx.emplace(std::make_pair(order.orderkey, mOrders.size()-1));
-        });
-
-        // create lineitem tuples within orders
-        using lineitem_t = std::tuple<int32_t, int32_t, int32_t, int32_t, double, double, double, double, crossbow::string, crossbow::string, date, date, date, crossbow::string, crossbow::string, crossbow::string>;
-        getFields<lineitem_t>(lineItemIn, [&] (const lineitem_t& fields) {
-            int32_t orderKey = std::get<0>(fields);
-            auto it = orderIdToIdx.find(orderKey);
-            if (it == orderIdToIdx.end())
-                LOG_ERROR("Error: no order found with orderkey " + std::to_string(orderKey));
-            Order &order = mOrders[it->second];
-            order.lineitems.emplace_back();
-            Lineitem &item = order.lineitems.back();
-            item.orderkey =      std::get<0>(fields);
-            item.partkey =       std::get<1>(fields);
-            item.suppkey =       std::get<2>(fields);
-            item.linenumber =    std::get<3>(fields);
-            item.quantity =      std::get<4>(fields);
-            item.extendedprice = std::get<5>(fields);
-            item.discount =      std::get<6>(fields);
-            item.tax =           std::get<7>(fields);
-            item.returnflag =    std::get<8>(fields);
-            item.linestatus =    std::get<9>(fields);
-            item.shipdate =      std::get<10>(fields).value;
-            item.commitdate =    std::get<11>(fields).value;
-            item.receiptdate =   std::get<12>(fields).value;
-            item.shipinstruct =  std::get<13>(fields);
-            item.shipmode =      std::get<14>(fields);
-            item.comment =       std::get<15>(fields);
-        });
+        mUpdateFile = updateFileIndex;
+        try {
+            if (!loadUpdateFile(baseDir, updateFileIndex, mOrders))
+                LOG_ERROR("Error: update file " + std::to_string(updateFileIndex+1) + " does not exist in " + baseDir);
+        } catch (std::exception& ex) {
+            LOG_ERROR("Error: " + std::string(ex.what()));
+        }
 
         // create delete orders
         mDeletes.reserve(mOrders.size());
@@ -147,18 +110,63 @@ void Client::execute(const typename Signature<C>::arguments &arg) {
 
     void Client::run(decltype(Clock::now()) endTime) {
         mEndTime = endTime;
+        if (!mCompactWire && !mCompressor) {
+            run();
+            return;
+        }
+        // RF1 batches are only sent compactly or compressed once the server
+        // agreed to it
+        uint32_t features = encodingBit(WireEncoding::CROSSBOW);
+        if (mCompactWire)
+            features |= encodingBit(WireEncoding::COMPACT);
+        if (mCompressor)
+            features |= compressedFramesBit;
+        mCmds.execute<Command::NEGOTIATE>([this](const err_code& ec, uint32_t features) {
+            if (ec) {
+                LOG_ERROR("Error: " + ec.message());
+                return;
+            }
+            if (mCompactWire) {
+                if (features & encodingBit(WireEncoding::COMPACT))
+                    mCmds.setEncoding(WireEncoding::COMPACT);
+                else
+                    LOG_WARN("Server does not support the compact encoding");
+            }
+            if (mCompressor) {
+                if (features & compressedFramesBit)
+                    mCmds.setCompressor(mCompressor);
+                else
+                    LOG_WARN("Server does not support compressed frames");
+            }
+            run();
+        }, features);
     }
 
     void Client::run() {
         // determine whether we are at that start of a batch and take timestamp if necessary
-        if (mBatchCounter == 0)
+        if (mBatchCounter == 0) {
+            if (mInFlight > 0)
+                return;
             mBatchStartTime = Clock::now();
+            if (mBatchStartTime > mEndTime) {
+                // Time's up
+                // benchmarking finished
+                mStream->close();
+                return;
+            }
+            mBatchAttempts = 0;
+            mBatchSuccess = true;
+            mBatchConflict = false;
+            mBatchError.clear();
+        }
+        while (mInFlight < mPipelineDepth && mBatchCounter < mUpdateBatchSize) {
+            sendSubBatch();
+        }
+    }
 
-        // determine size of current batch to be sent and whether is the last one
-        uint batchSize = mUpdateBatchSize - mBatchCounter;
-        mIsLast = batchSize <= orderBatchSize;
-        if (!mIsLast)
-            batchSize = orderBatchSize;
+    void Client::sendSubBatch() {
+        // determine size of the sub-batch to be sent
+        uint batchSize = std::min(mUpdateBatchSize - mBatchCounter, orderBatchSize);
 
         // determine batchStartIndex, endIdx and modular endIdx to take data from
         size_t batchStartIndex = mCurrentStartIdx + mBatchCounter;
@@ -167,14 +175,23 @@ void Client::execute(const typename Signature<C>::arguments &arg) {
 
         // do update or insert
         mBatchCounter += batchSize;
-        if (mDoInsert) {
+        if (mDoInsert && mByReference) {
+            LOG_DEBUG("Start RF1 Transaction by reference");
+            RF1RefIn ref;
+            ref.updateFile = mUpdateFile;
+            ref.first = uint32_t(batchStartIndex);
+            ref.count = uint32_t(endIdx - batchStartIndex);
+            if (modularEndIdx != endIdx)
+                ref.count += uint32_t(modularEndIdx);
+            execute<Command::RF1_REF>(std::move(ref));
+        } else if (mDoInsert) {
             LOG_DEBUG("Start RF1 Transaction");
             RF1In rf1args ({std::vector<Order>(&mOrders[batchStartIndex], &mOrders[endIdx])});
             if (modularEndIdx != endIdx)
                 rf1args.orders.insert(rf1args.orders.end(), &mOrders[0], &mOrders[modularEndIdx]);
             LOG_DEBUG("Input has %1$ orders. First order in batch has ID %2.",
                       rf1args.orders.size(), rf1args.orders[0].orderkey);
-            execute<Command::RF1>(rf1args);
+            execute<Command::RF1>(std::move(rf1args));
         } else {
             LOG_DEBUG("Start RF2 Transaction");
             RF2In rf2args ({std::vector<int32_t>(&mDeletes[batchStartIndex], &mDeletes[endIdx])});
@@ -182,7 +199,7 @@ void Client::execute(const typename Signature<C>::arguments &arg) {
                 rf2args.orderIds.insert(rf2args.orderIds.end(), &mDeletes[0], &mDeletes[modularEndIdx]);
             LOG_DEBUG("Input has $1$ orders. First order in batch has ID %2%.",
                       rf2args.orderIds.size(), rf2args.orderIds[0]);
-            execute<Command::RF2>(rf2args);
+            execute<Command::RF2>(std::move(rf2args));
         }
     }
 
@@ -23,9 +23,11 @@
 #pragma once
 #include <boost/asio.hpp>
 #include <common/Protocol.hpp>
+#include <common/UpdateSets.hpp>
 #include <random>
 #include <chrono>
 #include <deque>
+#include <memory>
 
 #include <common/Util.hpp>
 
@@ -35,40 +37,44 @@ using Clock = std::chrono::system_clock;
 
 struct LogEntry {
     bool success;
+    bool conflict;
+    uint32_t attempts; // summed over the sub-batches
     crossbow::string error;
     Command transaction;
     decltype(Clock::now()) start;
     decltype(start) end;
 };
 
-static const std::string orderFilePrefix = "orders.tbl.u";
-static const std::string lineitemFilePrefix = "lineitem.tbl.u";
 static const uint orderBatchSize = 100; // size of sub-batches of an update batch to be sent to the server
 
 class Client {
-    using Socket = boost::asio::ip::tcp::socket;
-    Socket mSocket;
+    std::unique_ptr<Stream> mStream;
     client::CommandsImpl mCmds;
     std::vector<Order> mOrders;
     std::vector<int32_t> mDeletes;
+    uint32_t mUpdateFile; // index of the update file mOrders are from
     uint mCurrentStartIdx;
     bool mDoInsert; // true for RF1, false for RF2
     const uint mUpdateBatchSize;  // batch size to be logged as an update
-    uint mBatchCounter;
-    bool mIsLast;   // is last subbatch of a batch
+    uint mBatchCounter; // orders of the current batch sent so far
+    const uint mPipelineDepth; // sub-batches of a batch sent without waiting for the previous ones
+    const bool mCompactWire; // negotiate the compact encoding for RF1 before running
+    Compressor* mCompressor; // negotiate compressed frames before running, optional
+    const bool mByReference; // send RF1 batches as RF1_REF, the server has to have loaded the update files
+    uint mInFlight;
+    // outcome of the current batch over all its sub-batches
+    bool mBatchSuccess;
+    bool mBatchConflict;
+    uint32_t mBatchAttempts;
+    crossbow::string mBatchError;
     decltype(Clock::now()) mBatchStartTime;
     decltype(Clock::now()) mEndTime;
     std::deque<LogEntry> mLog;
 
 public:
-    Client(boost::asio::io_service& service, const uint updateBatchSize);
+    Client(std::unique_ptr<Stream> stream, const uint updateBatchSize, const uint pipelineDepth = 1,
+            const bool compactWire = false, Compressor* compressor = nullptr, const bool byReference = false);
 
-    Socket& socket() {
-        return mSocket;
-    }
-    const Socket& socket() const {
-        return mSocket;
-    }
     client::CommandsImpl& commands() {
         return mCmds;
     }
@@ -79,8 +85,9 @@ public:
     const std::deque<LogEntry>& log() const { return mLog; }
 private:
     void run(); // executes RF1 (with mUpdateBatchSize inserted orders), followed by RF2 (the same orders deleted) repeatedly
+    void sendSubBatch();
     template<Command C>
-    void execute(const typename Signature<C>::arguments& arg);
+    void execute(typename Signature<C>::arguments arg);
 };
 
 } // namespace tpch
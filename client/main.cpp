@@ -26,6 +26,7 @@
 
 #include <boost/asio.hpp>
 #include <boost/system/error_code.hpp>
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <cassert>
@@ -33,6 +34,7 @@
 
 #include <thread>
 
+#include <common/Compression.hpp>
 #include <common/Util.hpp>
 
 #include "Client.hpp"
@@ -51,11 +53,18 @@ int main(int argc, const char** argv) {
     size_t numClients = 1;
     std::string baseDir = "/mnt/SG/braunl-tpch-data/all/1";
     uint batchSize = 1500;
+    uint pipelineDepth = 1;
     unsigned time = 5*60;
     bool exit = false;
+    std::string transport("tcp");
+    bool compactWire = false;
+    size_t compressThreshold = 0;
+    size_t compressThreads = 1;
+    bool byReference = false;
     auto opts = create_options("tpch_client",
             value<'h'>("help", &help, tag::description{"print help"})
-            , value<'H'>("host", &host, tag::description{"Comma-separated list of hosts"})
+            , value<'H'>("host", &host, tag::description{"Comma-separated list of hosts, or of socket paths for the unix and shm transports"})
+            , value<-1>("transport", &transport, tag::description{"tcp, unix (Unix domain socket) or shm (shared memory, same host only)"})
             , value<'l'>("log-level", &logLevel, tag::description{"The log level"})
             , value<'c'>("num-clients", &numClients, tag::description{"Number of Clients to run per host"})
             , value<'P'>("populate", &populate, tag::description{"Populate the database"})
@@ -63,6 +72,11 @@ int main(int argc, const char** argv) {
             , value<'o'>("out", &outFile, tag::description{"Path to the output file"})
             , value<'d'>("base-dir", &baseDir, tag::description{"Base directory to the generated tbl/upd/del files, assumes for population that this base-dir exists on server as well."})
             , value<'b'>("batch-size", &batchSize, tag::description{"Batch Size for RF1/RF2 to be logged."})
+            , value<-1>("compact-wire", &compactWire, tag::description{"Send RF1 batches in the compact encoding if the server agrees"})
+            , value<-1>("compress-threshold", &compressThreshold, tag::description{"Compress requests of at least this many bytes with LZ4 if the server agrees, 0 disables it"})
+            , value<-1>("compress-threads", &compressThreads, tag::description{"Number of threads compressing requests"})
+            , value<-1>("by-reference", &byReference, tag::description{"Send RF1 batches as ranges of the update files, the server has to load them with --update-dir"})
+            , value<-1>("pipeline", &pipelineDepth, tag::description{"Number of sub-batches of a batch a client sends without waiting for a response"})
             , value<-1>("exit", &exit, tag::description{"Quit server"})
             );
     try {
@@ -87,36 +101,30 @@ int main(int argc, const char** argv) {
     crossbow::logger::logger->config.level = crossbow::logger::logLevelFromString(logLevel);
     try {
         auto hosts = tpch::split(host.c_str(), ',');
+        auto transportType = tpch::parseTransport(transport);
         io_service service;
+        std::unique_ptr<tpch::Compressor> compressor;
+        if (compressThreshold > 0) {
+            if (!tpch::compressionSupported()) {
+                std::cerr << "Code was not compiled with LZ4\n";
+                return 1;
+            }
+            compressor.reset(new tpch::Compressor(std::max(compressThreads, size_t(1)), compressThreshold));
+        }
 
-        // do client creation multi-threaded as it may take a while
         LOG_DEBUG("Start client creation.");
         auto sumClients = hosts.size() * numClients;
         std::vector<std::unique_ptr<tpch::Client>> clients;
         clients.reserve(sumClients);
         for (decltype(sumClients) i = 0; i < sumClients; ++i) {
-            clients.emplace_back(new tpch::Client(service, batchSize));
+            // consecutive clients go to different hosts to better distribute population requests to servers
+            auto stream = tpch::connect(service, transportType, hosts[i % hosts.size()], port);
+            LOG_INFO("Connected to client " + crossbow::to_string(i));
+            clients.emplace_back(new tpch::Client(std::move(stream), batchSize, pipelineDepth, compactWire,
+                    compressor.get(), byReference));
         }
         LOG_DEBUG("Client creation finished.");
 
-        for (size_t i = 0; i < hosts.size(); ++i) {
-            auto h = hosts[i];
-            auto addr = tpch::split(h, ':');
-            assert(addr.size() <= 2);
-            auto p = addr.size() == 2 ? addr[1] : port;
-            ip::tcp::resolver resolver(service);
-            ip::tcp::resolver::iterator iter;
-            if (host == "") {
-                iter = resolver.resolve(ip::tcp::resolver::query(p));
-            } else {
-                iter = resolver.resolve(ip::tcp::resolver::query(addr[0], p));
-            }
-            for (unsigned j = 0; j < numClients; ++j) {
-                LOG_INFO("Connected to client " + crossbow::to_string(i*numClients + j));
-                boost::asio::connect(clients[j*hosts.size()+ i]->socket(), iter); // changed i and j to better distribute population requests to servers
-            }
-        }
-
         {
             auto t = std::time(nullptr);
             std::string dateString(20, '\0');
@@ -193,9 +201,11 @@ int main(int argc, const char** argv) {
         }
 END:
         service.run();
+        if (compressor)
+            LOG_INFO(tpch::compressionReport());
         LOG_INFO("Done, writing results");
         std::ofstream out(outFile.c_str());
-        out << "start,end,transaction,success,error\n";
+        out << "start,end,transaction,success,conflict,attempts,error\n";
         for (const auto& client : clients) {
             const auto& queue = client->log();
             for (const auto& e : queue) {
@@ -214,6 +224,8 @@ END:
                     tName = "RF2";
                     break;
                 case tpch::Command::EXIT:
+                case tpch::Command::NEGOTIATE:
+                case tpch::Command::RF1_REF:
                     assert(false);
                     break;
                 }
@@ -221,6 +233,8 @@ END:
                     << std::chrono::duration_cast<std::chrono::milliseconds>(e.end - startTime).count() << ','
                     << tName << ','
                     << (e.success ? "true" : "false") << ','
+                    << (e.conflict ? "true" : "false") << ','
+                    << e.attempts << ','
                     << e.error << std::endl;
             }
         }
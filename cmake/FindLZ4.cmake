@@ -0,0 +1,23 @@
+# - Find LZ4
+
+# Look for the LZ4 header
+find_path(LZ4_INCLUDE_DIR
+        NAMES lz4.h
+        HINTS ${LZ4_ROOT} ENV LZ4_ROOT
+        PATH_SUFFIXES include)
+
+# Look for the LZ4 library
+find_library(LZ4_LIBRARY
+        NAMES lz4
+        HINTS ${LZ4_ROOT} ENV LZ4_ROOT
+        PATH_SUFFIXES lib)
+
+set(LZ4_LIBRARIES ${LZ4_LIBRARY})
+set(LZ4_INCLUDE_DIRS ${LZ4_INCLUDE_DIR})
+
+mark_as_advanced(LZ4_INCLUDE_DIR LZ4_LIBRARY)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LZ4
+        FOUND_VAR LZ4_FOUND
+        REQUIRED_VARS LZ4_LIBRARY LZ4_INCLUDE_DIR)
@@ -0,0 +1,97 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace tpch {
+
+namespace {
+
+std::atomic<uint64_t> arenaAllocations{0};
+std::atomic<uint64_t> arenaBytes{0};
+std::atomic<uint64_t> arenaBlocks{0};
+std::atomic<uint64_t> arenaResets{0};
+
+} // anonymous namespace
+
+constexpr size_t Arena::blockSize;
+constexpr size_t Arena::retainBytes;
+
+void Arena::countAllocation(size_t size) {
+    arenaAllocations.fetch_add(1, std::memory_order_relaxed);
+    arenaBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void Arena::nextBlock(size_t minSize) {
+    if (mPos != nullptr)
+        ++mCurrent;
+    if (mCurrent == mBlocks.size() || mBlocks[mCurrent].capacity() < minSize) {
+        mBlocks.insert(mBlocks.begin() + mCurrent, PooledBuffer(BufferPool::shared(), std::max(blockSize, minSize)));
+        arenaBlocks.fetch_add(1, std::memory_order_relaxed);
+    }
+    mPos = mBlocks[mCurrent].data();
+    mEnd = mPos + mBlocks[mCurrent].capacity();
+}
+
+void Arena::reset() {
+    size_t retained = 0;
+    auto keep = std::find_if(mBlocks.begin(), mBlocks.end(), [&retained](const PooledBuffer& block) {
+        retained += block.capacity();
+        return retained > retainBytes;
+    });
+    mBlocks.erase(keep, mBlocks.end());
+    mCurrent = 0;
+    mPos = nullptr;
+    mEnd = nullptr;
+    arenaResets.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string Arena::report() {
+    return "arenas: " + std::to_string(arenaResets) + " requests, "
+        + std::to_string(arenaAllocations) + " allocations ("
+        + std::to_string(arenaBytes / 1024) + "KiB) from "
+        + std::to_string(arenaBlocks) + " pooled blocks";
+}
+
+std::shared_ptr<Arena> ArenaPool::acquire() {
+    std::unique_ptr<Arena> arena;
+    {
+        std::lock_guard<std::mutex> _(mMutex);
+        if (!mFree.empty()) {
+            arena = std::move(mFree.back());
+            mFree.pop_back();
+        }
+    }
+    if (!arena)
+        arena.reset(new Arena());
+    auto self = shared_from_this();
+    return std::shared_ptr<Arena>(arena.release(), [self](Arena* arena) {
+        arena->reset();
+        std::lock_guard<std::mutex> _(self->mMutex);
+        self->mFree.emplace_back(arena);
+    });
+}
+
+} // namespace tpch
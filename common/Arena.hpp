@@ -0,0 +1,132 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BufferPool.hpp"
+
+namespace tpch {
+
+/**
+ * Monotonic allocator for everything that lives exactly as long as one
+ * request: the received frame, the parsed arguments, temporary arrays of the
+ * transaction and the reply. Allocations bump a pointer through a list of
+ * blocks and are only released all together by reset(). The blocks come from
+ * the shared BufferPool and are kept for the next request (up to
+ * retainBytes), so a warm arena does not even touch the pool.
+ */
+class Arena {
+    static constexpr size_t blockSize = 64 * 1024;
+    static constexpr size_t retainBytes = 1024 * 1024;
+
+    std::vector<PooledBuffer> mBlocks;
+    size_t mCurrent = 0;
+    uint8_t* mPos = nullptr;
+    uint8_t* mEnd = nullptr;
+
+    void nextBlock(size_t minSize);
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        auto pos = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(mPos) + alignment - 1) & ~(alignment - 1));
+        if (mPos == nullptr || pos + size > mEnd) {
+            nextBlock(size + alignment);
+            pos = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(mPos) + alignment - 1) & ~(alignment - 1));
+        }
+        mPos = pos + size;
+        countAllocation(size);
+        return pos;
+    }
+
+    template<class T>
+    T* allocate(size_t n) {
+        return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    // releases all allocations at once
+    void reset();
+
+    // totals over all arenas since the start, allocations served from blocks
+    // compared to the blocks taken from the pool
+    static std::string report();
+private:
+    static void countAllocation(size_t size);
+};
+
+// makes containers allocate from an arena, deallocation is a no-op so the
+// memory of a container stays valid until the arena gets reset
+template<class T>
+struct ArenaAllocator {
+    using value_type = T;
+    Arena* arena;
+
+    ArenaAllocator(Arena& arena)
+        : arena(&arena)
+    {}
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+        : arena(other.arena)
+    {}
+
+    T* allocate(size_t n) {
+        return arena->allocate<T>(n);
+    }
+
+    void deallocate(T*, size_t) {}
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena == b.arena;
+}
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena != b.arena;
+}
+
+template<class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+/**
+ * The arenas of one connection. Every request gets its own arena as several
+ * requests of a connection may be in flight, the arena is reset and returns
+ * to the pool as soon as the last reference to it is gone.
+ */
+class ArenaPool : public std::enable_shared_from_this<ArenaPool> {
+    std::mutex mMutex;
+    std::vector<std::unique_ptr<Arena>> mFree;
+public:
+    std::shared_ptr<Arena> acquire();
+};
+
+} // namespace tpch
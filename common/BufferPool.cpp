@@ -0,0 +1,91 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include "BufferPool.hpp"
+
+namespace tpch {
+
+constexpr size_t BufferPool::minClassShift;
+constexpr size_t BufferPool::numClasses;
+constexpr size_t BufferPool::retainBytes;
+
+BufferPool::~BufferPool() {
+    for (auto& sizeClass : mClasses) {
+        for (auto buffer : sizeClass.free) {
+            delete[] buffer;
+        }
+    }
+}
+
+BufferPool& BufferPool::shared() {
+    static BufferPool pool;
+    return pool;
+}
+
+size_t BufferPool::classOf(size_t size) {
+    size_t c = 0;
+    while (c < numClasses && (size_t(1) << (minClassShift + c)) < size) {
+        ++c;
+    }
+    return c;
+}
+
+uint8_t* BufferPool::acquire(size_t size, size_t& capacity) {
+    auto c = classOf(size);
+    if (c == numClasses) {
+        capacity = size;
+        mMisses.fetch_add(1, std::memory_order_relaxed);
+        return new uint8_t[size];
+    }
+    capacity = size_t(1) << (minClassShift + c);
+    {
+        auto& sizeClass = mClasses[c];
+        std::lock_guard<std::mutex> _(sizeClass.mutex);
+        if (!sizeClass.free.empty()) {
+            auto buffer = sizeClass.free.back();
+            sizeClass.free.pop_back();
+            mHits.fetch_add(1, std::memory_order_relaxed);
+            return buffer;
+        }
+    }
+    mMisses.fetch_add(1, std::memory_order_relaxed);
+    return new uint8_t[capacity];
+}
+
+void BufferPool::release(uint8_t* buffer, size_t capacity) {
+    auto c = classOf(capacity);
+    if (c < numClasses) {
+        auto& sizeClass = mClasses[c];
+        std::lock_guard<std::mutex> _(sizeClass.mutex);
+        if ((sizeClass.free.size() + 1) * capacity <= retainBytes) {
+            sizeClass.free.emplace_back(buffer);
+            return;
+        }
+    }
+    delete[] buffer;
+}
+
+std::string BufferPool::report() const {
+    return "buffer pool: " + std::to_string(mHits) + " hits, " + std::to_string(mMisses) + " misses";
+}
+
+} // namespace tpch
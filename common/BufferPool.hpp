@@ -0,0 +1,106 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tpch {
+
+/**
+ * Buffers for received frames and arena blocks, shared by all connections of
+ * a process. Sizes are rounded up to a power of two, every size class keeps
+ * its released buffers for the next acquire up to a limit. Buffers above the
+ * largest class come from the heap directly.
+ */
+class BufferPool {
+    static constexpr size_t minClassShift = 12;     // 4 KiB
+    static constexpr size_t numClasses = 13;        // up to 16 MiB
+    static constexpr size_t retainBytes = 64 * 1024 * 1024; // per size class
+
+    struct SizeClass {
+        std::mutex mutex;
+        std::vector<uint8_t*> free;
+    };
+    std::array<SizeClass, numClasses> mClasses;
+    std::atomic<uint64_t> mHits{0};
+    std::atomic<uint64_t> mMisses{0};
+
+    static size_t classOf(size_t size);
+public:
+    BufferPool() = default;
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    ~BufferPool();
+
+    // the pool of the process
+    static BufferPool& shared();
+
+    // returns a buffer of at least size bytes, capacity is set to its actual size
+    uint8_t* acquire(size_t size, size_t& capacity);
+    // capacity has to be the one acquire returned
+    void release(uint8_t* buffer, size_t capacity);
+
+    // how many acquires were served from the pool
+    std::string report() const;
+};
+
+// a buffer from a pool that goes back to it on destruction
+class PooledBuffer {
+    BufferPool* mPool = nullptr;
+    uint8_t* mData = nullptr;
+    size_t mCapacity = 0;
+public:
+    PooledBuffer() = default;
+    PooledBuffer(BufferPool& pool, size_t size)
+        : mPool(&pool)
+        , mData(pool.acquire(size, mCapacity))
+    {}
+    PooledBuffer(PooledBuffer&& other)
+        : mPool(other.mPool)
+        , mData(other.mData)
+        , mCapacity(other.mCapacity)
+    {
+        other.mData = nullptr;
+    }
+    PooledBuffer& operator=(PooledBuffer&& other) {
+        std::swap(mPool, other.mPool);
+        std::swap(mData, other.mData);
+        std::swap(mCapacity, other.mCapacity);
+        return *this;
+    }
+    ~PooledBuffer() {
+        if (mData)
+            mPool->release(mData, mCapacity);
+    }
+
+    uint8_t* data() const { return mData; }
+    size_t capacity() const { return mCapacity; }
+};
+
+} // namespace tpch
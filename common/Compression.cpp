@@ -0,0 +1,163 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include "Compression.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <ctime>
+
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+
+namespace tpch {
+
+namespace {
+
+std::atomic<uint64_t> compressedFrames(0);
+std::atomic<uint64_t> uncompressibleFrames(0);
+std::atomic<uint64_t> rawBytes(0);
+std::atomic<uint64_t> compressedBytes(0);
+std::atomic<uint64_t> compressNanos(0);
+std::atomic<uint64_t> decompressedFrames(0);
+std::atomic<uint64_t> decompressNanos(0);
+
+// CPU time of the calling thread
+uint64_t threadNanos() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+
+} // anonymous namespace
+
+#ifdef USE_LZ4
+
+bool compressionSupported() {
+    return true;
+}
+
+size_t compressFrame(const std::vector<boost::asio::const_buffer>& buffers, size_t skip,
+        size_t headerSize, PooledBuffer& out) {
+    auto start = threadNanos();
+    size_t total = 0;
+    for (auto& buffer : buffers) {
+        total += boost::asio::buffer_size(buffer);
+    }
+    auto rawSize = total - skip;
+    // LZ4 needs the input in one piece
+    PooledBuffer input(BufferPool::shared(), rawSize);
+    size_t pos = 0;
+    for (auto& buffer : buffers) {
+        auto data = boost::asio::buffer_cast<const uint8_t*>(buffer);
+        auto size = boost::asio::buffer_size(buffer);
+        auto skipped = std::min(size, skip);
+        skip -= skipped;
+        std::memcpy(input.data() + pos, data + skipped, size - skipped);
+        pos += size - skipped;
+    }
+    auto bound = size_t(LZ4_compressBound(int(rawSize)));
+    auto offset = headerSize + compressedBodyHeaderSize;
+    if (out.capacity() < offset + bound)
+        out = PooledBuffer(BufferPool::shared(), offset + bound);
+    auto size = LZ4_compress_default(reinterpret_cast<const char*>(input.data()),
+            reinterpret_cast<char*>(out.data() + offset), int(rawSize), int(bound));
+    size_t result = 0;
+    if (size > 0 && compressedBodyHeaderSize + size_t(size) < rawSize) {
+        auto uncompressed = uint32_t(rawSize);
+        std::memcpy(out.data() + headerSize, &uncompressed, sizeof(uncompressed));
+        result = offset + size_t(size);
+        compressedFrames.fetch_add(1, std::memory_order_relaxed);
+        rawBytes.fetch_add(rawSize, std::memory_order_relaxed);
+        compressedBytes.fetch_add(result - headerSize, std::memory_order_relaxed);
+    } else {
+        uncompressibleFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+    compressNanos.fetch_add(threadNanos() - start, std::memory_order_relaxed);
+    return result;
+}
+
+bool decompressBody(const uint8_t* body, size_t size, uint8_t* out, size_t outSize) {
+    auto start = threadNanos();
+    auto result = LZ4_decompress_safe(reinterpret_cast<const char*>(body + compressedBodyHeaderSize),
+            reinterpret_cast<char*>(out), int(size - compressedBodyHeaderSize), int(outSize));
+    decompressedFrames.fetch_add(1, std::memory_order_relaxed);
+    decompressNanos.fetch_add(threadNanos() - start, std::memory_order_relaxed);
+    return result >= 0 && size_t(result) == outSize;
+}
+
+#else
+
+bool compressionSupported() {
+    return false;
+}
+
+size_t compressFrame(const std::vector<boost::asio::const_buffer>&, size_t, size_t, PooledBuffer&) {
+    return 0;
+}
+
+bool decompressBody(const uint8_t*, size_t, uint8_t*, size_t) {
+    return false;
+}
+
+#endif
+
+uint32_t uncompressedSize(const uint8_t* body) {
+    uint32_t size;
+    std::memcpy(&size, body, sizeof(size));
+    return size;
+}
+
+std::string compressionReport() {
+    uint64_t raw = rawBytes;
+    uint64_t compressed = compressedBytes;
+    auto ratio = compressed == 0 ? 0.0 : double(raw) / double(compressed);
+    return "compression: " + std::to_string(compressedFrames) + " frames ("
+        + std::to_string(uncompressibleFrames) + " not compressible), "
+        + std::to_string(raw / 1024) + "KiB to " + std::to_string(compressed / 1024) + "KiB, ratio "
+        + std::to_string(ratio) + ", " + std::to_string(compressNanos / 1000000) + "ms CPU compressing, "
+        + std::to_string(decompressedFrames) + " frames in " + std::to_string(decompressNanos / 1000000)
+        + "ms CPU decompressing";
+}
+
+Compressor::Compressor(size_t numThreads, size_t threshold)
+    : mWork(new boost::asio::io_service::work(mService))
+    , mThreshold(threshold)
+{
+    mThreads.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; ++i) {
+        mThreads.emplace_back([this]() {
+            mService.run();
+        });
+    }
+}
+
+Compressor::~Compressor() {
+    mWork.reset();
+    for (auto& t : mThreads) {
+        t.join();
+    }
+}
+
+} // namespace tpch
@@ -0,0 +1,93 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "BufferPool.hpp"
+
+namespace tpch {
+
+// a frame whose size has this bit set carries a compressed body: the size of
+// the uncompressed body as uint32_t followed by an LZ4 block
+constexpr size_t compressedFrameBit = size_t(1) << (sizeof(size_t) * 8 - 1);
+
+// whether this build can compress and decompress frames (USE_LZ4)
+bool compressionSupported();
+
+/**
+ * Compresses the bytes of buffers after the first skip ones into out, which
+ * gets room for a header of headerSize bytes, the uncompressed size and the
+ * LZ4 block. Returns the number of bytes used in out, or 0 if compressing
+ * does not make the frame smaller.
+ */
+size_t compressFrame(const std::vector<boost::asio::const_buffer>& buffers, size_t skip,
+        size_t headerSize, PooledBuffer& out);
+
+// decompresses the body of a compressed frame into out, which has to be as
+// large as the uncompressed size the body starts with, returns false if the
+// body is corrupt
+bool decompressBody(const uint8_t* body, size_t size, uint8_t* out, size_t outSize);
+
+// reads the uncompressed size of a compressed body
+uint32_t uncompressedSize(const uint8_t* body);
+constexpr size_t compressedBodyHeaderSize = sizeof(uint32_t);
+
+// an LZ4 block never decompresses to more than this many times its size, a
+// larger uncompressed size means the body is corrupt
+constexpr size_t maxCompressionRatio = 255;
+
+// compression ratio and CPU time of all frames of the process
+std::string compressionReport();
+
+/**
+ * Compresses request frames on its own threads, so the io thread of the
+ * client only serializes. Frames below the threshold are not worth it.
+ */
+class Compressor {
+    boost::asio::io_service mService;
+    std::unique_ptr<boost::asio::io_service::work> mWork;
+    std::vector<std::thread> mThreads;
+    size_t mThreshold;
+public:
+    Compressor(size_t numThreads, size_t threshold);
+    // waits until all queued jobs are done
+    ~Compressor();
+
+    size_t threshold() const {
+        return mThreshold;
+    }
+
+    template<class Job>
+    void post(Job job) {
+        mService.post(job);
+    }
+};
+
+} // namespace tpch
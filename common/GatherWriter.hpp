@@ -0,0 +1,172 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+
+#include <crossbow/Serializer.hpp>
+#include <crossbow/string.hpp>
+
+namespace tpch {
+
+/**
+ * Serializes a message in the crossbow format in a single pass into a list of
+ * buffers for a gathering write. Fixed size fields and short strings are
+ * copied into chunks taken from Chunks::allocate(size), strings longer than
+ * the inline limit are not copied but referenced by a buffer of their own, so
+ * they have to stay alive until the write completed. The chunks are never
+ * moved, so the frame size can be filled in at the end.
+ */
+template<class Chunks, class Buffers = std::vector<boost::asio::const_buffer>>
+class GatherWriter {
+    Chunks& mChunks;
+    Buffers mBuffers;
+    size_t mInlineLimit;
+    size_t mChunkSize;
+    uint8_t* mSegment = nullptr; // start of the part of the chunk not in mBuffers yet
+    uint8_t* mPos = nullptr;
+    uint8_t* mEnd = nullptr;
+    size_t mSize = 0;
+
+    uint8_t* reserve(size_t size) {
+        if (mPos + size > mEnd) {
+            closeSegment();
+            auto chunkSize = std::max(mChunkSize, size);
+            mSegment = mPos = mChunks.allocate(chunkSize);
+            mEnd = mPos + chunkSize;
+        }
+        auto pos = mPos;
+        mPos += size;
+        mSize += size;
+        return pos;
+    }
+
+    void closeSegment() {
+        if (mPos != mSegment)
+            mBuffers.emplace_back(mSegment, size_t(mPos - mSegment));
+        mSegment = mPos;
+    }
+public:
+    // strings of at most inlineLimit bytes get copied
+    GatherWriter(Chunks& chunks, size_t chunkSize,
+            size_t inlineLimit = std::numeric_limits<size_t>::max(), Buffers buffers = Buffers())
+        : mChunks(chunks)
+        , mBuffers(std::move(buffers))
+        , mInlineLimit(inlineLimit)
+        , mChunkSize(chunkSize)
+    {}
+
+    // space for a field that gets filled in later, e.g. the frame size
+    template<class T>
+    T* placeholder() {
+        return reinterpret_cast<T*>(reserve(sizeof(T)));
+    }
+
+    // total number of bytes written so far
+    size_t size() const {
+        return mSize;
+    }
+
+    // copies raw bytes
+    void write(const void* data, size_t size) {
+        std::memcpy(reserve(size), data, size);
+    }
+
+    // the buffers to write, the writer must not be used anymore afterwards
+    Buffers& buffers() {
+        closeSegment();
+        return mBuffers;
+    }
+
+    template<class T>
+    typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value, GatherWriter&>::type
+    operator& (const T& value) {
+        write(&value, sizeof(T));
+        return *this;
+    }
+
+    GatherWriter& operator& (const crossbow::string& str) {
+        auto length = uint32_t(str.size());
+        *this & length;
+        if (length <= mInlineLimit) {
+            write(str.data(), length);
+        } else {
+            closeSegment();
+            mBuffers.emplace_back(str.data(), length);
+            mSize += length;
+        }
+        return *this;
+    }
+
+    template<class T>
+    GatherWriter& operator& (const std::vector<T>& vec) {
+        *this & uint32_t(vec.size());
+        for (auto& elem : vec) {
+            *this & elem;
+        }
+        return *this;
+    }
+
+    template<class A, class B>
+    GatherWriter& operator& (const std::pair<A, B>& pair) {
+        *this & pair.first;
+        return *this & pair.second;
+    }
+
+    template<class... T>
+    GatherWriter& operator& (const std::tuple<T...>& tuple) {
+        writeTuple<0>(tuple);
+        return *this;
+    }
+
+    template<class T>
+    typename std::enable_if<std::is_same<typename T::is_serializable, crossbow::is_serializable>::value,
+            GatherWriter&>::type
+    operator& (const T& obj) {
+        // the structs only have a non-const operator& for all archivers
+        const_cast<T&>(obj) & *this;
+        return *this;
+    }
+
+private:
+    template<size_t I, class Tuple>
+    typename std::enable_if<(I < std::tuple_size<Tuple>::value), void>::type
+    writeTuple(const Tuple& tuple) {
+        *this & std::get<I>(tuple);
+        writeTuple<I + 1>(tuple);
+    }
+
+    template<size_t I, class Tuple>
+    typename std::enable_if<(I == std::tuple_size<Tuple>::value), void>::type
+    writeTuple(const Tuple&) {}
+};
+
+} // namespace tpch
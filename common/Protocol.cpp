@@ -24,3 +24,271 @@
 
 
 
+
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+namespace tpch {
+
+namespace {
+
+// fails a request whose arguments end before size more bytes at pos
+void checkRemaining(const uint8_t* pos, const uint8_t* end, uint64_t size) {
+    if (size > uint64_t(end - pos))
+        throw std::invalid_argument("Request ends within its arguments");
+}
+
+// reads the crossbow serialization format: scalars are stored as they are,
+// strings and vectors are prefixed with their uint32_t length
+class ArgumentReader {
+    const uint8_t* mPos;
+    const uint8_t* mEnd;
+public:
+    ArgumentReader(const uint8_t* pos, const uint8_t* end)
+        : mPos(pos)
+        , mEnd(end)
+    {}
+
+    size_t remaining() const {
+        return size_t(mEnd - mPos);
+    }
+
+    template<class T>
+    void operator& (T& value) {
+        checkRemaining(mPos, mEnd, sizeof(T));
+        std::memcpy(&value, mPos, sizeof(T));
+        mPos += sizeof(T);
+    }
+
+    void operator& (StringView& str) {
+        *this & str.length;
+        checkRemaining(mPos, mEnd, str.length);
+        str.data = reinterpret_cast<const char*>(mPos);
+        mPos += str.length;
+    }
+};
+
+// reads orders and lineitems in the crossbow encoding
+class CrossbowOrderReader {
+    ArgumentReader mReader;
+public:
+    CrossbowOrderReader(const uint8_t* pos, const uint8_t* end)
+        : mReader(pos, end)
+    {}
+
+    size_t remaining() const {
+        return mReader.remaining();
+    }
+
+    uint32_t count() {
+        uint32_t count;
+        mReader & count;
+        return count;
+    }
+
+    void order(OrderView& order) {
+        mReader & order.orderkey;
+        mReader & order.custkey;
+        mReader & order.orderstatus;
+        mReader & order.totalprice;
+        mReader & order.orderdate;
+        mReader & order.orderpriority;
+        mReader & order.clerk;
+        mReader & order.shippriority;
+        mReader & order.comment;
+    }
+
+    void lineitem(const OrderView&, LineitemView& line) {
+        mReader & line.orderkey;
+        mReader & line.partkey;
+        mReader & line.suppkey;
+        mReader & line.linenumber;
+        mReader & line.quantity;
+        mReader & line.extendedprice;
+        mReader & line.discount;
+        mReader & line.tax;
+        mReader & line.returnflag;
+        mReader & line.linestatus;
+        mReader & line.shipdate;
+        mReader & line.commitdate;
+        mReader & line.receiptdate;
+        mReader & line.shipinstruct;
+        mReader & line.shipmode;
+        mReader & line.comment;
+    }
+};
+
+// reads orders and lineitems written by CompactEncoder, expanded clerk names
+// are allocated from the arena
+class CompactOrderReader {
+    const uint8_t* mPos;
+    const uint8_t* mEnd;
+    Arena& mArena;
+
+    // a 64 bit value takes at most 10 bytes
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            checkRemaining(mPos, mEnd, 1);
+            auto byte = *mPos++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw std::invalid_argument("Varint longer than 10 bytes");
+    }
+
+    int64_t signedVarint() {
+        auto value = varint();
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+
+    char byte() {
+        checkRemaining(mPos, mEnd, 1);
+        return char(*mPos++);
+    }
+
+    StringView string() {
+        auto length = varint();
+        checkRemaining(mPos, mEnd, length);
+        StringView str;
+        str.length = uint32_t(length);
+        str.data = reinterpret_cast<const char*>(mPos);
+        mPos += str.length;
+        return str;
+    }
+
+    StringView text(const Dictionary& dictionary) {
+        auto code = varint();
+        if (code == 0)
+            return string();
+        if (code > dictionary.size)
+            throw std::invalid_argument("Invalid dictionary code " + std::to_string(code));
+        StringView str;
+        str.data = dictionary.values[code - 1];
+        str.length = uint32_t(std::strlen(str.data));
+        return str;
+    }
+
+    StringView clerk() {
+        auto code = uint32_t(varint());
+        if (code == 0)
+            return string();
+        auto name = mArena.allocate<char>(clerkLength);
+        clerkName(code, name);
+        StringView str;
+        str.data = name;
+        str.length = uint32_t(clerkLength);
+        return str;
+    }
+public:
+    CompactOrderReader(const uint8_t* pos, const uint8_t* end, Arena& arena)
+        : mPos(pos)
+        , mEnd(end)
+        , mArena(arena)
+    {}
+
+    size_t remaining() const {
+        return size_t(mEnd - mPos);
+    }
+
+    uint32_t count() {
+        return uint32_t(varint());
+    }
+
+    void order(OrderView& order) {
+        order.orderkey = int32_t(varint());
+        order.custkey = int32_t(varint());
+        order.orderstatus = byte();
+        order.totalprice = signedVarint();
+        order.orderdate = int32_t(signedVarint());
+        order.orderpriority = text(orderpriorityDictionary);
+        order.clerk = clerk();
+        order.shippriority = int32_t(signedVarint());
+        order.comment = string();
+    }
+
+    void lineitem(const OrderView& order, LineitemView& line) {
+        line.orderkey = int32_t(order.orderkey + signedVarint());
+        line.partkey = int32_t(varint());
+        line.suppkey = int32_t(varint());
+        line.linenumber = int32_t(varint());
+        line.quantity = signedVarint();
+        line.extendedprice = signedVarint();
+        line.discount = signedVarint();
+        line.tax = signedVarint();
+        line.returnflag = byte();
+        line.linestatus = byte();
+        line.shipdate = int32_t(order.orderdate + signedVarint());
+        line.commitdate = int32_t(order.orderdate + signedVarint());
+        line.receiptdate = int32_t(line.shipdate + signedVarint());
+        line.shipinstruct = text(shipinstructDictionary);
+        line.shipmode = text(shipmodeDictionary);
+        line.comment = string();
+    }
+};
+
+template<class Reader>
+ArrayView<OrderView> readOrders(Reader& reader, Arena& arena) {
+    auto numOrders = reader.count();
+    // every order takes at least one byte, so a count from a broken frame
+    // cannot allocate more than the frame is long
+    if (numOrders > reader.remaining())
+        throw std::invalid_argument("More orders than the request has bytes");
+    auto orderViews = arena.allocate<OrderView>(numOrders);
+    // an order has at most 7 lineitems, the orders get their ranges once
+    // the array does not grow anymore
+    ArenaVector<LineitemView> lineitems(arena);
+    lineitems.reserve(7 * size_t(numOrders));
+    auto firstLineitem = arena.allocate<size_t>(numOrders + 1);
+    for (uint32_t i = 0; i < numOrders; ++i) {
+        auto& order = *new (orderViews + i) OrderView();
+        reader.order(order);
+        auto numLineitems = reader.count();
+        firstLineitem[i] = lineitems.size();
+        for (uint32_t j = 0; j < numLineitems; ++j) {
+            lineitems.emplace_back();
+            reader.lineitem(order, lineitems.back());
+        }
+    }
+    firstLineitem[numOrders] = lineitems.size();
+    // the memory of the vector stays valid until the arena is reset
+    for (uint32_t i = 0; i < numOrders; ++i) {
+        orderViews[i].lineitems = ArrayView<LineitemView>(lineitems.data() + firstLineitem[i],
+                lineitems.data() + firstLineitem[i + 1]);
+    }
+    return ArrayView<OrderView>(orderViews, orderViews + numOrders);
+}
+
+} // anonymous namespace
+
+RF1InView::RF1InView(std::shared_ptr<Arena> arena, const uint8_t* pos, const uint8_t* end,
+        WireEncoding encoding)
+    : mArena(std::move(arena))
+{
+    if (encoding == WireEncoding::COMPACT) {
+        CompactOrderReader reader(pos, end, *mArena);
+        orders = readOrders(reader, *mArena);
+    } else {
+        CrossbowOrderReader reader(pos, end);
+        orders = readOrders(reader, *mArena);
+    }
+}
+
+RF2InView::RF2InView(std::shared_ptr<Arena> arena, const uint8_t* pos, const uint8_t* end)
+    : mArena(std::move(arena))
+{
+    ArgumentReader ar(pos, end);
+    uint32_t numOrders;
+    ar & numOrders;
+    checkRemaining(pos, end, sizeof(numOrders) + uint64_t(numOrders) * sizeof(int32_t));
+    auto orderIdsBegin = mArena->allocate<int32_t>(numOrders);
+    for (uint32_t i = 0; i < numOrders; ++i) {
+        ar & orderIdsBegin[i];
+    }
+    orderIds = ArrayView<int32_t>(orderIdsBegin, orderIdsBegin + numOrders);
+}
+
+} // namespace tpch
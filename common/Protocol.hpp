@@ -21,9 +21,17 @@
  *     Lucas Braun <braunl@inf.ethz.ch>
  */
 #pragma once
+#include <algorithm>
 #include <tuple>
 #include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
 #include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/system/error_code.hpp>
 #include <boost/asio.hpp>
@@ -32,6 +40,13 @@
 #include <crossbow/Serializer.hpp>
 #include <crossbow/string.hpp>
 
+#include "Arena.hpp"
+#include "BufferPool.hpp"
+#include "Compression.hpp"
+#include "GatherWriter.hpp"
+#include "Transport.hpp"
+#include "WireEncoding.hpp"
+
 #define GEN_COMMANDS_ARR(Name, arr) enum class Name {\
     BOOST_PP_ARRAY_ELEM(0, arr) = 1, \
     BOOST_PP_ARRAY_ENUM(BOOST_PP_ARRAY_REMOVE(arr, 0)) \
@@ -50,21 +65,29 @@
         BOOST_PP_ARRAY_REMOVE(BOOST_PP_TUPLE_ELEM(2, 1, state), 0) \
         )\
 
-#define SWITCH_CASE_IMPL(Name, Param, arr) switch (Param) {\
+#define SWITCH_CASE_IMPL(Name, Param, arr, Default) switch (Param) {\
     BOOST_PP_FOR((Name, arr), SWITCH_PREDICATE, SWITCH_REMOVE_ELEM, EXPAND_CASE) \
+default: \
+    Default \
 }
 
-#define SWITCH_CASE(Name, Param, t) SWITCH_CASE_IMPL(Name, Param, (BOOST_PP_TUPLE_SIZE(t), t))
+// runs Default for values that are none of the elements of t
+#define SWITCH_CASE(Name, Param, t, Default) SWITCH_CASE_IMPL(Name, Param, (BOOST_PP_TUPLE_SIZE(t), t), Default)
 
 namespace tpch {
 
-#define COMMANDS (CREATE_SCHEMA, POPULATE, EXIT, RF1, RF2)
+#define COMMANDS (CREATE_SCHEMA, POPULATE, EXIT, RF1, RF2, NEGOTIATE, RF1_REF)
 
 GEN_COMMANDS(Command, COMMANDS);
 
 template<Command C>
 struct Signature;
 
+// every frame starts with its total size and a tag, the server answers a
+// request with the tag of the request, as replies can arrive out of order
+using tag_t = uint32_t;
+constexpr size_t frameHeaderSize = sizeof(size_t) + sizeof(tag_t);
+
 template<>
 struct Signature<Command::CREATE_SCHEMA> {
     using result = std::tuple<bool, crossbow::string>;
@@ -83,6 +106,14 @@ struct Signature<Command::EXIT> {
     using arguments = void;
 };
 
+// handled by the protocol itself, see WireEncoding
+template<>
+struct Signature<Command::NEGOTIATE> {
+    using result = uint32_t;    // the features the connection uses from now on
+    using arguments = uint32_t; // encodingBit of every encoding the client supports, and compressedFramesBit
+};
+
+// decimals are sent as hundredths (see decimal), dates as days since 1.1.1970
 struct Lineitem {
     using is_serializable = crossbow::is_serializable;
 
@@ -90,15 +121,15 @@ struct Lineitem {
     int32_t partkey;
     int32_t suppkey;
     int32_t linenumber;
-    double quantity;
-    double extendedprice;
-    double discount;
-    double tax;
-    crossbow::string returnflag;
-    crossbow::string linestatus;
-    int64_t shipdate;
-    int64_t commitdate;
-    int64_t receiptdate;
+    int64_t quantity;
+    int64_t extendedprice;
+    int64_t discount;
+    int64_t tax;
+    char returnflag;
+    char linestatus;
+    int32_t shipdate;
+    int32_t commitdate;
+    int32_t receiptdate;
     crossbow::string shipinstruct;
     crossbow::string shipmode;
     crossbow::string comment;
@@ -129,9 +160,9 @@ struct Order {
 
     int32_t orderkey;
     int32_t custkey;
-    crossbow::string orderstatus;
-    double totalprice;
-    int64_t orderdate;
+    char orderstatus;
+    int64_t totalprice;
+    int32_t orderdate;
     crossbow::string orderpriority;
     crossbow::string clerk;
     int32_t shippriority;
@@ -164,17 +195,106 @@ struct RF1In {
     }
 };
 
+// a string inside a received request frame
+struct StringView {
+    const char* data = nullptr;
+    uint32_t length = 0;
+};
+
+// a contiguous sequence of elements owned by someone else
+template<class T>
+struct ArrayView {
+    using value_type = T;
+    using const_iterator = const T*;
+
+    const T* first = nullptr;
+    const T* last = nullptr;
+
+    ArrayView() = default;
+    ArrayView(const T* first, const T* last)
+        : first(first)
+        , last(last)
+    {}
+
+    const T* begin() const { return first; }
+    const T* end() const { return last; }
+    size_t size() const { return size_t(last - first); }
+    const T& operator[](size_t i) const { return first[i]; }
+    bool empty() const { return first == last; }
+};
+
+// Lineitem, Order and RF1In as the server reads them: the strings point into
+// the request frame and the lineitems of all orders share one array, which
+// are all allocated from the arena of the request
+struct LineitemView {
+    int32_t orderkey;
+    int32_t partkey;
+    int32_t suppkey;
+    int32_t linenumber;
+    int64_t quantity;
+    int64_t extendedprice;
+    int64_t discount;
+    int64_t tax;
+    char returnflag;
+    char linestatus;
+    int32_t shipdate;
+    int32_t commitdate;
+    int32_t receiptdate;
+    StringView shipinstruct;
+    StringView shipmode;
+    StringView comment;
+};
+
+struct OrderView {
+    int32_t orderkey;
+    int32_t custkey;
+    char orderstatus;
+    int64_t totalprice;
+    int32_t orderdate;
+    StringView orderpriority;
+    StringView clerk;
+    int32_t shippriority;
+    StringView comment;
+    ArrayView<LineitemView> lineitems;
+};
+
+struct RF1RefIn;
+class UpdateSets;
+
+// copies share the arena, which stays alive as long as one copy exists
+class RF1InView {
+    std::shared_ptr<Arena> mArena;
+public:
+    ArrayView<OrderView> orders;
+
+    RF1InView() = default;
+    // parses a serialized RF1In in [pos, end), which is allocated from arena,
+    // throws std::invalid_argument if it is malformed
+    RF1InView(std::shared_ptr<Arena> arena, const uint8_t* pos, const uint8_t* end,
+            WireEncoding encoding = WireEncoding::CROSSBOW);
+    // the orders a reference names in the update sets of the server, see
+    // UpdateSets::resolve
+    RF1InView(std::shared_ptr<Arena> arena, const UpdateSets& sets, const RF1RefIn& ref);
+
+    // for temporary data of the transaction
+    Arena& arena() const { return *mArena; }
+};
+
 struct RF1Out {
     using is_serializable = crossbow::is_serializable;
     bool success = true;
+    bool conflict = false;  // failed because of a conflict, trying again might succeed
     crossbow::string error;
     int32_t affectedRows = 0;
+    uint32_t attempts = 1;  // number of times the server ran the transaction
 
     template<class Archiver>
     void operator&(Archiver& ar) {
         ar & success;
+        ar & conflict;
         ar & error;
         ar & affectedRows;
+        ar & attempts;
     }
 };
 
@@ -184,6 +304,29 @@ struct Signature<Command::RF1> {
     using arguments = RF1In;
 };
 
+// an RF1 batch as a range of the orders of an update file the server loaded,
+// the server answers it like the RF1 of these orders
+struct RF1RefIn {
+    using is_serializable = crossbow::is_serializable;
+
+    uint32_t updateFile = 0; // index of the file, like Client::prepare gets it
+    uint32_t first = 0;      // index of the first order in the file
+    uint32_t count = 0;      // wraps around at the end of the file
+
+    template<class Archiver>
+    void operator&(Archiver& ar) {
+        ar & updateFile;
+        ar & first;
+        ar & count;
+    }
+};
+
+template<>
+struct Signature<Command::RF1_REF> {
+    using result = RF1Out;
+    using arguments = RF1RefIn;
+};
+
 struct RF2In {
     using is_serializable = crossbow::is_serializable;
 
@@ -195,17 +338,34 @@ struct RF2In {
     }
 };
 
+// RF2In as the server reads it
+class RF2InView {
+    std::shared_ptr<Arena> mArena;
+public:
+    ArrayView<int32_t> orderIds;
+
+    RF2InView() = default;
+    // parses a serialized RF2In in [pos, end) like RF1InView
+    RF2InView(std::shared_ptr<Arena> arena, const uint8_t* pos, const uint8_t* end);
+
+    Arena& arena() const { return *mArena; }
+};
+
 struct RF2Out {
     using is_serializable = crossbow::is_serializable;
     bool success = true;
+    bool conflict = false;  // failed because of a conflict, trying again might succeed
     crossbow::string error;
     int32_t affectedRows = 0;
+    uint32_t attempts = 1;  // number of times the server ran the transaction
 
     template<class Archiver>
     void operator&(Archiver& ar) {
         ar & success;
+        ar & conflict;
         ar & error;
         ar & affectedRows;
+        ar & attempts;
     }
 };
 
@@ -215,29 +375,111 @@ struct Signature<Command::RF2> {
     using arguments = RF2In;
 };
 
-namespace impl {
+// the type the server reads the arguments of a command into
+template<Command C>
+struct RequestArguments {
+    using type = typename Signature<C>::arguments;
+};
 
-template<class... Args>
-struct ArgSerializer;
+template<>
+struct RequestArguments<Command::RF1> {
+    using type = RF1InView;
+};
 
-template<class Head, class... Tail>
-struct ArgSerializer<Head, Tail...> {
-    ArgSerializer<Tail...> rest;
+template<>
+struct RequestArguments<Command::RF2> {
+    using type = RF2InView;
+};
 
-    template<class C>
-    void exec(C& c, const Head& head, const Tail&... tail) const {
-        c & head;
-        rest.exec(c, tail...);
+// completion handlers that run as they are, for FrameReader outside a strand
+struct DirectHandlers {
+    template<class Handler>
+    Handler wrap(Handler handler) {
+        return handler;
     }
 };
 
-template<>
-struct ArgSerializer<> {
-    template<class C>
-    void exec(C&) const {}
-};
+/**
+ * Reads frames from a stream: exactly the header first and then exactly the
+ * body into a buffer the owner provides for its size, so a frame takes two
+ * reads and is never grown or copied. A compressed body (compressedFrameBit)
+ * is read into a buffer of the reader and decompressed into the owner's. All
+ * completions go through Wrap::wrap, e.g. of a strand.
+ */
+template<class Socket, class Wrap>
+class FrameReader {
+    Socket& mSocket;
+    Wrap& mWrap;
+    uint8_t mHeader[frameHeaderSize];
+    // only replaced by a larger one from the pool
+    PooledBuffer mCompressed;
 
-}
+    template<class BodyBuffer, class Handler>
+    void readCompressed(tag_t tag, size_t frameSize, BodyBuffer& bodyBuffer, Handler& handler) {
+        if (frameSize <= frameHeaderSize + compressedBodyHeaderSize) {
+            handler(boost::asio::error::invalid_argument, tag, nullptr, size_t(0));
+            return;
+        }
+        auto size = frameSize - frameHeaderSize;
+        if (mCompressed.capacity() < size)
+            mCompressed = PooledBuffer(BufferPool::shared(), size);
+        boost::asio::async_read(mSocket, boost::asio::buffer(mCompressed.data(), size),
+                mWrap.wrap([this, tag, size, bodyBuffer, handler](const boost::system::error_code& ec, size_t) mutable {
+                    if (ec) {
+                        handler(ec, tag, nullptr, size_t(0));
+                        return;
+                    }
+                    auto bodySize = size_t(uncompressedSize(mCompressed.data()));
+                    // checked before allocating, the size comes from the peer
+                    if (bodySize > (size - compressedBodyHeaderSize) * maxCompressionRatio) {
+                        handler(boost::asio::error::invalid_argument, tag, nullptr, size_t(0));
+                        return;
+                    }
+                    auto body = bodyBuffer(bodySize);
+                    if (!decompressBody(mCompressed.data(), size, body, bodySize)) {
+                        handler(boost::asio::error::invalid_argument, tag, nullptr, size_t(0));
+                        return;
+                    }
+                    handler(ec, tag, body, bodySize);
+                }));
+    }
+public:
+    FrameReader(Socket& socket, Wrap& wrap)
+        : mSocket(socket)
+        , mWrap(wrap)
+    {}
+
+    // bodyBuffer(size) returns the buffer for a body of size bytes, which has
+    // to stay valid until handler(ec, tag, body, size) got called
+    template<class BodyBuffer, class Handler>
+    void read(BodyBuffer bodyBuffer, Handler handler) {
+        boost::asio::async_read(mSocket, boost::asio::buffer(mHeader, frameHeaderSize),
+                mWrap.wrap([this, bodyBuffer, handler](const boost::system::error_code& ec, size_t) mutable {
+                    if (ec) {
+                        handler(ec, tag_t(0), nullptr, size_t(0));
+                        return;
+                    }
+                    size_t frameSize;
+                    tag_t tag;
+                    std::memcpy(&frameSize, mHeader, sizeof(size_t));
+                    std::memcpy(&tag, mHeader + sizeof(size_t), sizeof(tag_t));
+                    if (frameSize & compressedFrameBit) {
+                        readCompressed(tag, frameSize & ~compressedFrameBit, bodyBuffer, handler);
+                        return;
+                    }
+                    if (frameSize < frameHeaderSize) {
+                        handler(boost::asio::error::invalid_argument, tag, nullptr, size_t(0));
+                        return;
+                    }
+                    auto size = frameSize - frameHeaderSize;
+                    auto body = bodyBuffer(size);
+                    boost::asio::async_read(mSocket, boost::asio::buffer(body, size),
+                            mWrap.wrap([tag, body, size, handler](const boost::system::error_code& ec, size_t) {
+                                handler(ec, tag, body, size);
+                            }));
+                }));
+    }
+};
 
 namespace client {
 
@@ -256,104 +498,279 @@ struct argsType<> {
     using type = void;
 };
 
+/**
+ * Sends requests over one connection without waiting for the responses of
+ * earlier ones. Every request carries a tag, the responses are read in one
+ * loop and handed to the callback of the request with the same tag, as the
+ * server may answer them in any order. Not thread-safe, all calls have to
+ * come from the thread running the io_service.
+ */
 class CommandsImpl {
-    boost::asio::ip::tcp::socket& mSocket;
-    size_t mCurrSize = 1024;
-    std::unique_ptr<uint8_t[]> mCurrentRequest;
+    using error_code = boost::system::error_code;
+    // gets the body of the response or an error
+    using Handler = std::function<void(const error_code&, const uint8_t*)>;
+
+    static constexpr size_t chunkSize = 4096;
+    // longer strings are sent from the arguments instead of being copied
+    static constexpr size_t inlineLimit = 64;
+
+    using Chunk = std::unique_ptr<uint8_t[]>;
+
+    // takes the chunks of a request from the pool of the connection
+    struct RequestChunks {
+        std::vector<Chunk>& pool;
+        std::vector<Chunk> chunks;
+
+        uint8_t* allocate(size_t size) {
+            if (size == chunkSize && !pool.empty()) {
+                chunks.emplace_back(std::move(pool.back()));
+                pool.pop_back();
+            } else {
+                chunks.emplace_back(new uint8_t[size]);
+            }
+            return chunks.back().get();
+        }
+    };
+
+    // a request frame while it gets compressed, owns everything the
+    // compressor reads
+    struct Compression {
+        std::vector<boost::asio::const_buffer> buffers;
+        std::vector<Chunk> chunks;
+        std::shared_ptr<const void> args;
+        PooledBuffer frame;
+        size_t size = 0;   // of frame, 0 if the request is sent uncompressed
+        bool done = false; // only accessed on the io thread
+    };
+
+    struct Request {
+        std::vector<boost::asio::const_buffer> buffers;
+        std::vector<Chunk> chunks;
+        std::shared_ptr<const void> args; // the buffers point into the arguments
+        std::shared_ptr<Compression> compression;
+    };
+
+    Stream& mStream;
+    tag_t mNextTag = 0;
+    WireEncoding mEncoding = WireEncoding::CROSSBOW;
+    Compressor* mCompressor = nullptr;
+    // requests waiting for their response
+    std::unordered_map<tag_t, Handler> mPending;
+    // serialized requests waiting to be written, the front one is being written
+    std::deque<Request> mWrites;
+    std::vector<Chunk> mFreeChunks;
+    bool mWriting = false;
+    bool mReading = false;
+    DirectHandlers mDirect;
+    FrameReader<Stream, DirectHandlers> mReader;
+    // only replaced by a larger one from the pool
+    PooledBuffer mResponse;
 public:
-    CommandsImpl(boost::asio::ip::tcp::socket& socket)
-        : mSocket(socket), mCurrentRequest(new uint8_t[mCurrSize])
+    CommandsImpl(Stream& stream)
+        : mStream(stream), mReader(stream, mDirect)
     {
     }
 
-    template<class Callback, class Result>
-    typename std::enable_if<std::is_void<Result>::value, void>::type
-    readResponse(const Callback& callback, size_t bytes_read = 0) {
-        assert(bytes_read <= 1);
-        if (bytes_read) {
-            boost::system::error_code noError;
-            callback(noError);
-        }
-        mSocket.async_read_some(boost::asio::buffer(mCurrentRequest.get(), mCurrSize),
-                [this, callback, bytes_read](const boost::system::error_code& ec, size_t br){
-                    if (ec) {
-                        error<Result>(ec, callback);
-                        return;
-                    }
-                    readResponse<Callback, Result>(callback, bytes_read + br);
-                });
+    // number of requests waiting for their response
+    size_t inFlight() const {
+        return mPending.size();
     }
 
-    template<class Callback, class Result>
-    typename std::enable_if<!std::is_void<Result>::value, void>::type
-    readResponse(const Callback& callback, size_t bytes_read = 0) {
-        auto respSize = *reinterpret_cast<size_t*>(mCurrentRequest.get());
-        if (bytes_read >= 8 && respSize == bytes_read) {
-            // response read
-            Result res;
-            boost::system::error_code noError;
-            crossbow::deserializer ser(mCurrentRequest.get() + sizeof(size_t));
-            ser & res;
-            callback(noError, res);
-            return;
-        } else if (bytes_read >= 8 && respSize > mCurrSize) {
-            std::unique_ptr<uint8_t[]> newBuf(new uint8_t[respSize]);
-            memcpy(newBuf.get(), mCurrentRequest.get(), mCurrSize);
-            mCurrentRequest.swap(newBuf);
-        }
-        mSocket.async_read_some(boost::asio::buffer(mCurrentRequest.get() + bytes_read, mCurrSize - bytes_read),
-                [this, callback, bytes_read](const boost::system::error_code& ec, size_t br){
-                    if (ec) {
-                        Result res;
-                        callback(ec, res);
-                        return;
-                    }
-                    readResponse<Callback, Result>(callback, bytes_read + br);
-                });
+    // how RF1 batches get encoded from now on, the server has to have agreed
+    // to it with NEGOTIATE
+    void setEncoding(WireEncoding encoding) {
+        mEncoding = encoding;
+    }
+
+    // requests of at least the threshold of the compressor get compressed by
+    // it from now on, the server has to have agreed to compressedFramesBit
+    void setCompressor(Compressor* compressor) {
+        mCompressor = compressor;
+    }
+
+    // the arguments are kept until the request is written
+    template<Command C, class Callback, class... Args>
+    void execute(const Callback& callback, Args&&... args) {
+        static_assert(
+                (std::is_void<typename Signature<C>::arguments>::value && std::is_void<argsType<Args...>>::value) ||
+                std::is_same<typename Signature<C>::arguments,
+                        typename argsType<typename std::decay<Args>::type...>::type>::value,
+                "Wrong function arguments");
+        using ResType = typename Signature<C>::result;
+        auto tag = mNextTag++;
+        // a tuple is serialized as its elements one after the other
+        auto arguments = std::make_shared<std::tuple<typename std::decay<Args>::type...>>(std::forward<Args>(args)...);
+        RequestChunks chunks{mFreeChunks, {}};
+        GatherWriter<RequestChunks> writer(chunks, chunkSize, inlineLimit);
+        auto size = writer.template placeholder<size_t>();
+        writer & tag;
+        writer & C;
+        writeArguments(writer, *arguments);
+        auto frameSize = writer.size();
+        std::memcpy(size, &frameSize, sizeof(size_t));
+
+        mPending.emplace(tag, [callback](const error_code& ec, const uint8_t* body) {
+            if (ec) {
+                error<ResType>(ec, callback);
+            } else {
+                deliver<ResType>(body, callback);
+            }
+        });
+        mWrites.emplace_back(Request{std::move(writer.buffers()), std::move(chunks.chunks), std::move(arguments), nullptr});
+        if (mCompressor && frameSize >= mCompressor->threshold())
+            compress(mWrites.back());
+        write();
+        readNext();
+    }
+
+private:
+    template<class Res, class Callback>
+    static typename std::enable_if<std::is_void<Res>::value, void>::type
+    deliver(const uint8_t*, const Callback& callback) {
+        error_code noError;
+        callback(noError);
     }
 
     template<class Res, class Callback>
-    typename std::enable_if<std::is_void<Res>::value, void>::type
-    error(const boost::system::error_code& ec, const Callback& callback) {
+    static typename std::enable_if<!std::is_void<Res>::value, void>::type
+    deliver(const uint8_t* body, const Callback& callback) {
+        Res res;
+        error_code noError;
+        crossbow::deserializer ser(body);
+        ser & res;
+        callback(noError, res);
+    }
+
+    template<class Res, class Callback>
+    static typename std::enable_if<std::is_void<Res>::value, void>::type
+    error(const error_code& ec, const Callback& callback) {
         callback(ec);
     }
 
     template<class Res, class Callback>
-    typename std::enable_if<!std::is_void<Res>::value, void>::type
-    error(const boost::system::error_code& ec, const Callback& callback) {
+    static typename std::enable_if<!std::is_void<Res>::value, void>::type
+    error(const error_code& ec, const Callback& callback) {
         Res res;
         callback(ec, res);
     }
 
-    template<Command C, class Callback, class... Args>
-    void execute(const Callback& callback, const Args&... args) {
-        static_assert(
-                (std::is_void<typename Signature<C>::arguments>::value && std::is_void<argsType<Args...>>::value) ||
-                std::is_same<typename Signature<C>::arguments, typename argsType<Args...>::type>::value,
-                "Wrong function arguments");
-        using ResType = typename Signature<C>::result;
-        crossbow::sizer sizer;
-        sizer & sizer.size;
-        sizer & C;
-        impl::ArgSerializer<Args...> argSerializer;
-        argSerializer.exec(sizer, args...);
-        if (mCurrSize < sizer.size) {
-            mCurrentRequest.reset(new uint8_t[sizer.size]);
-            mCurrSize = sizer.size;
+    template<class Writer, class Args>
+    void writeArguments(Writer& writer, const Args& args) {
+        writer & args;
+    }
+
+    template<class Writer>
+    void writeArguments(Writer& writer, const std::tuple<RF1In>& args) {
+        if (mEncoding == WireEncoding::COMPACT) {
+            CompactEncoder<Writer> encode(writer);
+            encode(std::get<0>(args));
+        } else {
+            writer & args;
         }
-        crossbow::serializer ser(mCurrentRequest.get());
-        ser & sizer.size;
-        ser & C;
-        argSerializer.exec(ser, args...);
-        ser.buffer.release();
-        boost::asio::async_write(mSocket, boost::asio::buffer(mCurrentRequest.get(), sizer.size),
-                    [this, callback](const boost::system::error_code& ec, size_t){
-                        if (ec) {
-                            error<ResType>(ec, callback);
-                            return;
+    }
+
+    // hands the request to the compressor, it gets written once that is done
+    void compress(Request& request) {
+        auto compression = std::make_shared<Compression>();
+        compression->buffers = std::move(request.buffers);
+        compression->chunks = std::move(request.chunks);
+        compression->args = std::move(request.args);
+        request.buffers.clear();
+        request.chunks.clear();
+        request.compression = compression;
+        auto& service = mStream.get_io_service();
+        mCompressor->post([this, &service, compression]() {
+            auto& c = *compression;
+            c.size = compressFrame(c.buffers, frameHeaderSize, frameHeaderSize, c.frame);
+            if (c.size > 0) {
+                // the header is at the start of the first chunk
+                auto frameSize = c.size | compressedFrameBit;
+                std::memcpy(c.frame.data(), &frameSize, sizeof(size_t));
+                std::memcpy(c.frame.data() + sizeof(size_t),
+                        boost::asio::buffer_cast<const uint8_t*>(c.buffers.front()) + sizeof(size_t), sizeof(tag_t));
+            }
+            service.post([this, compression]() {
+                compression->done = true;
+                write();
+            });
+        });
+    }
+
+    // writes the front request unless a write is pending or it still gets compressed
+    void write() {
+        if (mWriting || mWrites.empty())
+            return;
+        auto& request = mWrites.front();
+        if (request.compression) {
+            auto& compression = *request.compression;
+            if (!compression.done)
+                return;
+            if (compression.size > 0) {
+                request.buffers.assign(1, boost::asio::buffer(compression.frame.data(), compression.size));
+            } else {
+                request.buffers = compression.buffers;
+            }
+        }
+        mWriting = true;
+        boost::asio::async_write(mStream, request.buffers,
+                [this](const error_code& ec, size_t) {
+                    mWriting = false;
+                    if (ec) {
+                        mWrites.clear();
+                        failAll(ec);
+                        return;
+                    }
+                    auto& request = mWrites.front();
+                    for (auto& chunk : request.chunks) {
+                        mFreeChunks.emplace_back(std::move(chunk));
+                    }
+                    if (request.compression) {
+                        for (auto& chunk : request.compression->chunks) {
+                            mFreeChunks.emplace_back(std::move(chunk));
                         }
-                        readResponse<Callback, ResType>(callback);
-                    });
+                    }
+                    mWrites.pop_front();
+                    write();
+                });
+    }
+
+    // reads the next response as long as requests are waiting for one
+    void readNext() {
+        if (mReading || mPending.empty())
+            return;
+        mReading = true;
+        mReader.read([this](size_t size) {
+                    if (mResponse.capacity() < size)
+                        mResponse = PooledBuffer(BufferPool::shared(), size);
+                    return mResponse.data();
+                },
+                [this](const error_code& ec, tag_t tag, const uint8_t* body, size_t) {
+                    mReading = false;
+                    if (ec) {
+                        failAll(ec);
+                        return;
+                    }
+                    auto handler = mPending.find(tag);
+                    if (handler == mPending.end()) {
+                        // the stream cannot be trusted to match replies anymore
+                        mStream.close();
+                        failAll(boost::asio::error::invalid_argument);
+                        return;
+                    }
+                    auto callback = std::move(handler->second);
+                    mPending.erase(handler);
+                    callback(error_code(), body);
+                    readNext();
+                });
+    }
+
+    // fails all requests waiting for their response
+    void failAll(const error_code& ec) {
+        auto pending = std::move(mPending);
+        mPending.clear();
+        for (auto& request : pending) {
+            request.second(ec, nullptr);
+        }
     }
 };
 
@@ -364,19 +781,58 @@ namespace server {
 template<class Implementation>
 class Server {
     Implementation& mImpl;
-    boost::asio::ip::tcp::socket& mSocket;
-    size_t mBufSize = 1024;
-    std::unique_ptr<uint8_t[]> mBuffer;
+    Stream& mStream;
+    boost::asio::io_service::strand mStrand;
+    size_t mMaxInFlight;
+    size_t mInFlight = 0;
+    bool mReading = false;
+    bool mClosing = false;
+    // every request is read into its own arena
+    std::shared_ptr<ArenaPool> mArenas;
+    std::shared_ptr<Arena> mArena;
+    FrameReader<Stream, boost::asio::io_service::strand> mReader;
+    uint8_t* mBody = nullptr;
+    size_t mBodySize = 0;
+    tag_t mTag = 0;
+    WireEncoding mEncoding = WireEncoding::CROSSBOW;
+    const UpdateSets* mUpdateSets;
+    static constexpr size_t replyChunkSize = 256;
+
+    struct ArenaChunks {
+        Arena& arena;
+
+        uint8_t* allocate(size_t size) {
+            return arena.allocate<uint8_t>(size);
+        }
+    };
+
+    // a serialized reply, allocated from the arena of its request, which is
+    // declared first so it outlives the buffers
+    struct Reply {
+        std::shared_ptr<Arena> arena;
+        ArenaVector<boost::asio::const_buffer> buffers;
+    };
+    // replies waiting to be written, the front one is being written
+    std::deque<Reply> mReplies;
     using error_code = boost::system::error_code;
     bool doQuit = false;
 public:
-    Server(Implementation& impl, boost::asio::ip::tcp::socket& socket)
+    // up to maxInFlight requests of the connection get executed concurrently,
+    // their replies are sent in the order they complete. RF1_REF requests
+    // are resolved against updateSets if there are any.
+    Server(Implementation& impl, Stream& stream, size_t maxInFlight = 1, const UpdateSets* updateSets = nullptr)
         : mImpl(impl)
-        , mSocket(socket)
-        , mBuffer(new uint8_t[mBufSize])
+        , mStream(stream)
+        , mStrand(stream.get_io_service())
+        , mMaxInFlight(std::max(maxInFlight, size_t(1)))
+        , mArenas(std::make_shared<ArenaPool>())
+        , mReader(stream, mStrand)
+        , mUpdateSets(updateSets)
     {}
     void run() {
-        read();
+        mStrand.dispatch([this]() {
+            readNext();
+        });
     }
     void quit() {
         doQuit = true;
@@ -389,93 +845,215 @@ private:
     }
 
     template<Command C, class Callback>
-    typename std::enable_if<!std::is_void<typename Signature<C>::arguments>::value, void>::type
+    typename std::enable_if<!std::is_void<typename Signature<C>::arguments>::value
+            && C != Command::NEGOTIATE && C != Command::RF1 && C != Command::RF2 && C != Command::RF1_REF, void>::type
     execute(Callback callback) {
-        using Args = typename Signature<C>::arguments;
+        using Args = typename RequestArguments<C>::type;
         Args args;
-        crossbow::deserializer des(mBuffer.get() + sizeof(size_t) + sizeof(Command));
-        des & args;
+        readArguments(args);
+        mImpl.template execute<C>(args, callback);
+    }
+
+    // the encoding belongs to the connection, the implementation never sees it
+    template<Command C, class Callback>
+    typename std::enable_if<C == Command::NEGOTIATE, void>::type
+    execute(Callback callback) {
+        uint32_t supported;
+        readArguments(supported);
+        uint32_t features = encodingBit(WireEncoding::CROSSBOW);
+        mEncoding = WireEncoding::CROSSBOW;
+        if (supported & encodingBit(WireEncoding::COMPACT)) {
+            mEncoding = WireEncoding::COMPACT;
+            features = encodingBit(WireEncoding::COMPACT);
+        }
+        // compressed frames are always read, the client only needs to know
+        // whether this server can decompress them
+        if ((supported & compressedFramesBit) && compressionSupported())
+            features |= compressedFramesBit;
+        callback(features);
+    }
+
+    // a batch the server cannot decode fails the request, not the connection
+    template<Command C, class Callback>
+    typename std::enable_if<C == Command::RF1 || C == Command::RF2, void>::type
+    execute(Callback callback) {
+        typename RequestArguments<C>::type args;
+        try {
+            readArguments(args);
+        } catch (std::exception& ex) {
+            typename Signature<C>::result res;
+            res.success = false;
+            res.error = crossbow::string(ex.what());
+            callback(res);
+            return;
+        }
         mImpl.template execute<C>(args, callback);
     }
 
+    // the implementation executes the referenced orders as an RF1
+    template<Command C, class Callback>
+    typename std::enable_if<C == Command::RF1_REF, void>::type
+    execute(Callback callback) {
+        RF1RefIn ref;
+        readArguments(ref);
+        RF1InView args;
+        try {
+            if (mUpdateSets == nullptr)
+                throw std::runtime_error("Server did not load any update files");
+            args = RF1InView(mArena, *mUpdateSets, ref);
+        } catch (std::exception& ex) {
+            RF1Out res;
+            res.success = false;
+            res.error = crossbow::string(ex.what());
+            callback(res);
+            return;
+        }
+        mImpl.template execute<Command::RF1>(args, callback);
+    }
+
+    template<class Args>
+    void readArguments(Args& args) {
+        crossbow::deserializer des(mBody + sizeof(Command));
+        des & args;
+    }
+
+    void readArguments(RF1InView& args) {
+        args = RF1InView(mArena, mBody + sizeof(Command), mBody + mBodySize, mEncoding);
+    }
+
+    void readArguments(RF2InView& args) {
+        args = RF2InView(mArena, mBody + sizeof(Command), mBody + mBodySize);
+    }
+
     template<Command C>
     typename std::enable_if<std::is_void<typename Signature<C>::result>::value, void>::type execute() {
-        execute<C>([this]() {
-            // send the result back
-            mBuffer[0] = 1;
-            boost::asio::async_write(mSocket,
-                    boost::asio::buffer(mBuffer.get(), 1),
-                    [this](const error_code& ec, size_t bytes_written) {
-                        if (ec) {
-                            std::cerr << ec.message() << std::endl;
-                            return;
-                        }
-                        read(0);
-                    }
-            );
+        auto tag = mTag;
+        auto arena = mArena;
+        execute<C>([this, tag, arena]() {
+            size_t size = frameHeaderSize;
+            ArenaChunks chunks{*arena};
+            GatherWriter<ArenaChunks, ArenaVector<boost::asio::const_buffer>> writer(chunks, replyChunkSize,
+                    std::numeric_limits<size_t>::max(), ArenaVector<boost::asio::const_buffer>(*arena));
+            writer & size;
+            writer & tag;
+            reply(Reply{arena, std::move(writer.buffers())});
         });
     }
 
     template<Command C>
     typename std::enable_if<!std::is_void<typename Signature<C>::result>::value, void>::type execute() {
         using Res = typename Signature<C>::result;
-        execute<C>([this](const Res& result) {
-            // Serialize result
-            crossbow::sizer sizer;
-            sizer & sizer.size;
-            sizer & result;
-            if (mBufSize < sizer.size) {
-                mBuffer.reset(new uint8_t[sizer.size]);
+        auto tag = mTag;
+        auto arena = mArena;
+        execute<C>([this, tag, arena](const Res& result) {
+            // the result is gone once the callback returns, so the writer
+            // copies all strings
+            ArenaChunks chunks{*arena};
+            GatherWriter<ArenaChunks, ArenaVector<boost::asio::const_buffer>> writer(chunks, replyChunkSize,
+                    std::numeric_limits<size_t>::max(), ArenaVector<boost::asio::const_buffer>(*arena));
+            auto size = writer.template placeholder<size_t>();
+            writer & tag;
+            writer & result;
+            auto frameSize = writer.size();
+            std::memcpy(size, &frameSize, sizeof(size_t));
+            reply(Reply{arena, std::move(writer.buffers())});
+        });
+    }
+
+    // may be called from any thread
+    void reply(Reply reply) {
+        mStrand.dispatch([this, reply]() mutable {
+            --mInFlight;
+            if (mClosing) {
+                closeIfIdle();
+                return;
             }
-            crossbow::serializer ser(mBuffer.get());
-            ser & sizer.size;
-            ser & result;
-            ser.buffer.release();
-            // send the result back
-            boost::asio::async_write(mSocket,
-                    boost::asio::buffer(mBuffer.get(), sizer.size),
-                    [this](const error_code& ec, size_t bytes_written) {
-                        if (ec) {
-                            std::cerr << ec.message() << std::endl;
-                            mSocket.close();
-                            mImpl.close();
-                            return;
-                        }
-                        read(0);
-                    }
-            );
+            mReplies.emplace_back(std::move(reply));
+            if (mReplies.size() == 1)
+                write();
+            readNext();
         });
     }
-    void read(size_t bytes_read = 0) {
-        if (bytes_read == 0 && doQuit) {
-            mSocket.get_io_service().stop();
-        }
-        size_t reqSize = 0;
-        if (bytes_read != 0) {
-            reqSize = *reinterpret_cast<size_t*>(mBuffer.get());
-        }
-        if (bytes_read != 0 && reqSize == bytes_read) {
-            // done reading
-            auto cmd = *reinterpret_cast<Command*>(mBuffer.get() + sizeof(size_t));
-            SWITCH_CASE(Command, cmd, COMMANDS)
-            return;
-        } else if (bytes_read >= 8 && reqSize > mBufSize) {
-            std::unique_ptr<uint8_t[]> newBuf(new uint8_t[reqSize]);
-            memcpy(newBuf.get(), mBuffer.get(), mBufSize);
-            mBuffer.swap(newBuf);
-            mBufSize = reqSize;
-        }
-        mSocket.async_read_some(boost::asio::buffer(mBuffer.get() + bytes_read, mBufSize - bytes_read),
-                [this, bytes_read](const error_code& ec, size_t br){
+
+    void write() {
+        auto& reply = mReplies.front();
+        boost::asio::async_write(mStream,
+                reply.buffers,
+                mStrand.wrap([this](const error_code& ec, size_t bytes_written) {
                     if (ec) {
                         std::cerr << ec.message() << std::endl;
-                        mSocket.close();
-                        mImpl.close();
+                        mReplies.clear();
+                        fail();
+                        return;
+                    }
+                    if (mClosing) {
+                        mReplies.clear();
+                        closeIfIdle();
                         return;
                     }
-                    read(bytes_read + br);
+                    mReplies.pop_front();
+                    if (!mReplies.empty())
+                        write();
+                    readNext();
+                }));
+    }
+
+    // reads the next request unless enough requests are in flight
+    void readNext() {
+        if (mReading || mClosing || mInFlight >= mMaxInFlight)
+            return;
+        if (doQuit) {
+            // the implementation stops the whole server, not just this loop
+            if (mInFlight == 0 && mReplies.empty())
+                mImpl.stop();
+            return;
+        }
+        mReading = true;
+        mReader.read([this](size_t size) {
+                    mArena = mArenas->acquire();
+                    return mArena->allocate<uint8_t>(size);
+                },
+                [this](const error_code& ec, tag_t tag, uint8_t* body, size_t size) {
+                    mReading = false;
+                    if (ec || size < sizeof(Command)) {
+                        std::cerr << (ec ? ec.message() : "Frame without command") << std::endl;
+                        mArena.reset();
+                        fail();
+                        return;
+                    }
+                    ++mInFlight;
+                    mTag = tag;
+                    mBody = body;
+                    mBodySize = size;
+                    auto cmd = *reinterpret_cast<Command*>(mBody);
+                    SWITCH_CASE(Command, cmd, COMMANDS, {
+                        // nothing would ever answer the request
+                        std::cerr << "Unknown command " << int(cmd) << std::endl;
+                        --mInFlight;
+                        mArena.reset();
+                        mBody = nullptr;
+                        fail();
+                        return;
+                    })
+                    // the request holds on to the arena as long as it needs it
+                    mArena.reset();
+                    mBody = nullptr;
+                    readNext();
                 });
     }
+
+    void fail() {
+        mClosing = true;
+        mStream.close();
+        closeIfIdle();
+    }
+
+    // the implementation may only be closed once no request is in flight and
+    // no read or write is pending anymore, as they still call back
+    void closeIfIdle() {
+        if (mClosing && mInFlight == 0 && !mReading && mReplies.empty())
+            mImpl.close();
+    }
 };
 
 } // namespace server
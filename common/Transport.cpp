@@ -0,0 +1,568 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include "Transport.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <crossbow/logger.hpp>
+
+using namespace boost::asio;
+using error_code = boost::system::error_code;
+
+namespace tpch {
+
+TransportType parseTransport(const std::string& name) {
+    if (name == "tcp")
+        return TransportType::TCP;
+    if (name == "unix")
+        return TransportType::UNIX;
+    if (name == "shm")
+        return TransportType::SHM;
+    throw std::invalid_argument("Unknown transport " + name);
+}
+
+Stream::~Stream() = default;
+
+constexpr size_t ShmStream::ringSize;
+const std::string ShmStream::shmNamePrefix = "/tpch-";
+
+ShmStream::~ShmStream() {
+    {
+        std::lock_guard<std::mutex> _(mWakeUps->mutex);
+        mWakeUps->stream = nullptr;
+    }
+    error_code ec;
+    mSocket.close(ec);
+    if (mSegment)
+        munmap(mSegment, sizeof(Segment));
+}
+
+void ShmStream::map(const std::string& name, bool create) {
+    // the server only maps segments of clients and never follows a name
+    // outside of the shared memory directory
+    if (!create && (name.compare(0, shmNamePrefix.size(), shmNamePrefix) != 0
+            || name.find('/', 1) != std::string::npos))
+        throw std::runtime_error("Shared memory " + name + " is not one of a client");
+    auto fd = shm_open(name.c_str(), create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR | O_NOFOLLOW, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Could not open shared memory " + name + ": " + std::strerror(errno));
+    if (create && ftruncate(fd, sizeof(Segment)) != 0) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Could not size shared memory " + name + ": " + std::strerror(errno));
+    }
+    if (!create) {
+        // a shorter segment would fault on access, and the segment has to
+        // belong to the user of the connected client
+        struct stat st;
+        ucred peer;
+        socklen_t peerSize = sizeof(peer);
+        std::string error;
+        if (fstat(fd, &st) != 0)
+            error = std::strerror(errno);
+        else if (getsockopt(mSocket.native_handle(), SOL_SOCKET, SO_PEERCRED, &peer, &peerSize) != 0)
+            error = std::strerror(errno);
+        else if (size_t(st.st_size) < sizeof(Segment))
+            error = "segment too small";
+        else if (st.st_uid != peer.uid)
+            error = "segment not owned by the client";
+        if (!error.empty()) {
+            ::close(fd);
+            throw std::runtime_error("Could not use shared memory " + name + ": " + error);
+        }
+    }
+    auto addr = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        if (create)
+            shm_unlink(name.c_str());
+        throw std::runtime_error("Could not map shared memory " + name + ": " + std::strerror(errno));
+    }
+    // a new segment is zeroed, which is the empty state of both rings
+    mSegment = reinterpret_cast<Segment*>(addr);
+}
+
+void ShmStream::connect() {
+    static std::atomic<uint32_t> counter(0);
+    auto name = shmNamePrefix + std::to_string(getpid()) + "-" + std::to_string(counter++);
+    map(name, true);
+    mIn = &mSegment->rings[1];
+    mOut = &mSegment->rings[0];
+    try {
+        uint32_t size = name.size();
+        std::array<const_buffer, 2> buffers = {{ buffer(&size, sizeof(size)), buffer(name) }};
+        boost::asio::write(mSocket, buffers);
+        uint8_t ack;
+        boost::asio::read(mSocket, buffer(&ack, 1));
+    } catch (...) {
+        shm_unlink(name.c_str());
+        throw;
+    }
+    // both sides have it mapped now
+    shm_unlink(name.c_str());
+    mSocket.non_blocking(true);
+}
+
+void ShmStream::accept(const std::string& name) {
+    map(name, false);
+    mIn = &mSegment->rings[0];
+    mOut = &mSegment->rings[1];
+    uint8_t ack = 1;
+    boost::asio::write(mSocket, buffer(&ack, 1));
+    mSocket.non_blocking(true);
+}
+
+// copies from the in ring, returns false if it is empty or the peer broke it
+bool ShmStream::tryRead(size_t& bytes) {
+    if (mCorrupt)
+        return false;
+    auto tail = mIn->tail.load(std::memory_order_relaxed);
+    auto available = mIn->head.load(std::memory_order_acquire) - tail;
+    if (available == 0) {
+        // the writer either sees the flag or we see its data
+        mIn->readerWaiting.store(1);
+        available = mIn->head.load() - tail;
+        if (available == 0)
+            return false;
+    }
+    // head and tail live in memory the peer writes to
+    if (available > ringSize) {
+        corrupted();
+        return false;
+    }
+    auto dest = buffer_cast<uint8_t*>(mReadBuffer);
+    bytes = std::min<size_t>(available, buffer_size(mReadBuffer));
+    auto offset = tail % ringSize;
+    auto first = std::min(bytes, ringSize - offset);
+    std::memcpy(dest, mIn->data + offset, first);
+    std::memcpy(dest + first, mIn->data, bytes - first);
+    mIn->tail.store(tail + bytes);
+    if (mIn->writerWaiting.exchange(0))
+        wakePeer();
+    return true;
+}
+
+// copies as much of mWriteBuffers as fits into the out ring, returns false
+// if it is full or the peer broke it
+bool ShmStream::tryWrite(size_t& bytes) {
+    auto head = mOut->head.load(std::memory_order_relaxed);
+    auto used = head - mOut->tail.load(std::memory_order_acquire);
+    if (used == ringSize) {
+        mOut->writerWaiting.store(1);
+        used = head - mOut->tail.load();
+        if (used == ringSize)
+            return false;
+    }
+    if (used > ringSize) {
+        corrupted();
+        return false;
+    }
+    auto space = ringSize - used;
+    bytes = 0;
+    for (auto& b : mWriteBuffers) {
+        auto src = buffer_cast<const uint8_t*>(b);
+        auto size = std::min(buffer_size(b), space - bytes);
+        auto offset = (head + bytes) % ringSize;
+        auto first = std::min(size, ringSize - offset);
+        std::memcpy(mOut->data + offset, src, first);
+        std::memcpy(mOut->data, src + first, size - first);
+        bytes += size;
+        if (bytes == space)
+            break;
+    }
+    mOut->head.store(head + bytes);
+    if (mOut->readerWaiting.exchange(0))
+        wakePeer();
+    return true;
+}
+
+// fails the pending and all later operations, the stream cannot be trusted
+// anymore
+void ShmStream::corrupted() {
+    LOG_ERROR("Shared memory ring of the peer is corrupt, closing the stream");
+    mCorrupt = true;
+    mError = error::invalid_argument;
+    error_code ec;
+    mSocket.close(ec);
+}
+
+// a lost wake up only means the peer has enough of them queued already
+void ShmStream::wakePeer() {
+    uint8_t wakeUp = 1;
+    error_code ec;
+    mSocket.send(buffer(&wakeUp, 1), 0, ec);
+}
+
+void ShmStream::complete(Completion& completion, const error_code& ec, size_t bytes) {
+    auto c = std::move(completion);
+    completion = nullptr;
+    mService.post([c, ec, bytes]() {
+        c(ec, bytes);
+    });
+}
+
+// completes the pending operations that can make progress now
+void ShmStream::retry() {
+    size_t bytes = 0;
+    if (mRead) {
+        if (tryRead(bytes))
+            complete(mRead, error_code(), bytes);
+        else if (mError)
+            complete(mRead, mError, 0);
+    }
+    if (mWrite) {
+        if (mError)
+            complete(mWrite, mError, 0);
+        else if (tryWrite(bytes))
+            complete(mWrite, error_code(), bytes);
+        else if (mError)
+            complete(mWrite, mError, 0);
+    }
+    if ((mRead || mWrite) && !mError)
+        waitForPeer();
+}
+
+void ShmStream::waitForPeer() {
+    if (mWaiting)
+        return;
+    mWaiting = true;
+    auto wakeUps = mWakeUps;
+    mSocket.async_read_some(buffer(wakeUps->buffer), [wakeUps](const error_code& ec, size_t) {
+        std::lock_guard<std::mutex> guard(wakeUps->mutex);
+        auto stream = wakeUps->stream;
+        if (!stream)
+            return;
+        stream->wokenUp(ec);
+    });
+}
+
+// the wake up read completed, called with the lock of the wake ups held
+void ShmStream::wokenUp(const error_code& ec) {
+    std::lock_guard<std::mutex> _(mMutex);
+    mWaiting = false;
+    if (ec)
+        mError = (ec == error::operation_aborted ? error_code(error::eof) : ec);
+    retry();
+}
+
+void ShmStream::readSome(mutable_buffer buffer, Completion completion) {
+    std::lock_guard<std::mutex> _(mMutex);
+    if (buffer_size(buffer) == 0) {
+        complete(completion, error_code(), 0);
+        return;
+    }
+    mReadBuffer = buffer;
+    mRead = std::move(completion);
+    retry();
+}
+
+void ShmStream::writeSome(Completion completion) {
+    std::lock_guard<std::mutex> _(mMutex);
+    mWrite = std::move(completion);
+    retry();
+}
+
+void ShmStream::close() {
+    std::lock_guard<std::mutex> _(mMutex);
+    error_code ec;
+    mSocket.shutdown(local::stream_protocol::socket::shutdown_both, ec);
+    mSocket.close(ec);
+}
+
+Listener::~Listener() = default;
+
+namespace {
+
+class TcpListener : public Listener {
+    ip::tcp::acceptor mAcceptor;
+public:
+    TcpListener(io_service& service, const std::string& host, const std::string& port, bool reusePort);
+
+    void accept(io_service& service, Handler handler) override {
+        auto stream = new SocketStream<ip::tcp::socket>(service);
+        mAcceptor.async_accept(stream->socket(), [stream, handler](const error_code& ec) {
+            handler(ec, std::unique_ptr<Stream>(stream));
+        });
+    }
+};
+
+// lets several acceptors bind the same port, the kernel then spreads the
+// incoming connections over them
+using reuse_port = detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+TcpListener::TcpListener(io_service& service, const std::string& host, const std::string& port, bool reusePort)
+    : mAcceptor(service)
+{
+    ip::tcp::resolver resolver(service);
+    ip::tcp::resolver::iterator iter;
+    if (host == "") {
+        iter = resolver.resolve(ip::tcp::resolver::query(port));
+    } else {
+        iter = resolver.resolve(ip::tcp::resolver::query(host, port));
+    }
+    ip::tcp::resolver::iterator end;
+    for (; iter != end; ++iter) {
+        error_code err;
+        auto endpoint = iter->endpoint();
+        auto protocol = iter->endpoint().protocol();
+        mAcceptor.open(protocol);
+        mAcceptor.set_option(ip::tcp::acceptor::reuse_address(true));
+        if (reusePort)
+            mAcceptor.set_option(reuse_port(true));
+        mAcceptor.bind(endpoint, err);
+        if (err) {
+            mAcceptor.close();
+            LOG_WARN("Bind attempt failed " + err.message());
+            continue;
+        }
+        break;
+    }
+    if (!mAcceptor.is_open())
+        throw std::runtime_error("Could not bind");
+    mAcceptor.listen();
+}
+
+// a client that does not announce its segment in time is dropped
+constexpr auto shmHandshakeTimeout = std::chrono::seconds(5);
+
+/**
+ * For shared memory the listener keeps accepting on its own service and runs
+ * the handshake of every client on its own, so a slow or silent client does
+ * not hold up the others. Clients that finished their handshake wait for the
+ * next accept call, which picks the service their stream is served on.
+ */
+class UnixListener : public Listener {
+    // a connected client that still announces its segment, the strand orders
+    // the reads against the timeout
+    struct Handshake {
+        local::stream_protocol::socket socket;
+        io_service::strand strand;
+        steady_timer timer;
+        uint32_t nameSize = 0;
+        std::string name;
+        bool done = false;
+
+        Handshake(io_service& service)
+            : socket(service)
+            , strand(service)
+            , timer(service)
+        {}
+    };
+    using Request = std::pair<io_service*, Handler>;
+
+    io_service& mService;
+    local::stream_protocol::acceptor mAcceptor;
+    bool mShm;
+
+    std::mutex mMutex;
+    bool mAccepting = false;
+    error_code mError; // the acceptor failed, later requests fail with it
+    std::deque<std::shared_ptr<Handshake>> mReady;
+    std::deque<Request> mRequests;
+
+    void acceptShm(io_service& service, Handler handler) {
+        {
+            std::lock_guard<std::mutex> _(mMutex);
+            mRequests.emplace_back(&service, std::move(handler));
+            if (!mAccepting) {
+                mAccepting = true;
+                acceptNext();
+            }
+        }
+        mService.post([this]() {
+            dispatch();
+        });
+    }
+
+    // accepts again as soon as a client connected, before its handshake ran
+    void acceptNext() {
+        auto handshake = std::make_shared<Handshake>(mService);
+        mAcceptor.async_accept(handshake->socket, [this, handshake](const error_code& ec) {
+            if (ec) {
+                {
+                    std::lock_guard<std::mutex> _(mMutex);
+                    mError = ec;
+                }
+                dispatch();
+                return;
+            }
+            acceptNext();
+            shake(handshake);
+        });
+    }
+
+    // reads the name of the client's segment, the segment is mapped once a
+    // request picked the service of the stream
+    void shake(std::shared_ptr<Handshake> handshake) {
+        auto& h = *handshake;
+        h.timer.expires_from_now(shmHandshakeTimeout);
+        h.timer.async_wait(h.strand.wrap([handshake](const error_code& ec) {
+            if (ec || handshake->done)
+                return;
+            LOG_ERROR("Shared memory handshake timed out");
+            handshake->done = true;
+            error_code err;
+            handshake->socket.close(err);
+        }));
+        async_read(h.socket, buffer(&h.nameSize, sizeof(h.nameSize)), h.strand.wrap(
+                [this, handshake](const error_code& ec, size_t) {
+            auto& h = *handshake;
+            if (h.done)
+                return;
+            if (ec || h.nameSize == 0 || h.nameSize > 255) {
+                finish(handshake, ec ? ec : error_code(error::invalid_argument));
+                return;
+            }
+            h.name.resize(h.nameSize);
+            async_read(h.socket, buffer(&h.name[0], h.name.size()), h.strand.wrap(
+                    [this, handshake](const error_code& ec, size_t) {
+                if (!handshake->done)
+                    finish(handshake, ec);
+            }));
+        }));
+    }
+
+    void finish(const std::shared_ptr<Handshake>& handshake, const error_code& ec) {
+        handshake->done = true;
+        error_code err;
+        handshake->timer.cancel(err);
+        if (ec) {
+            // only this client failed to announce its segment
+            LOG_ERROR("Shared memory handshake failed: " + ec.message());
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> _(mMutex);
+            mReady.push_back(handshake);
+        }
+        dispatch();
+    }
+
+    // hands the clients that finished their handshake to the waiting requests
+    void dispatch() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mRequests.empty() && (!mReady.empty() || mError)) {
+            auto request = std::move(mRequests.front());
+            mRequests.pop_front();
+            if (mReady.empty()) {
+                auto ec = mError;
+                lock.unlock();
+                request.second(ec, nullptr);
+                lock.lock();
+                continue;
+            }
+            auto handshake = std::move(mReady.front());
+            mReady.pop_front();
+            lock.unlock();
+            std::unique_ptr<ShmStream> stream(new ShmStream(*request.first));
+            try {
+                stream->socket().assign(local::stream_protocol(), handshake->socket.release());
+                stream->accept(handshake->name);
+            } catch (std::exception& e) {
+                LOG_ERROR(std::string("Shared memory handshake failed: ") + e.what());
+                lock.lock();
+                mRequests.push_front(std::move(request));
+                continue;
+            }
+            request.second(error_code(), std::move(stream));
+            lock.lock();
+        }
+    }
+public:
+    UnixListener(io_service& service, const std::string& path, bool shm)
+        : mService(service)
+        , mAcceptor(service)
+        , mShm(shm)
+    {
+        // a previous server may have left its socket behind
+        ::unlink(path.c_str());
+        local::stream_protocol::endpoint endpoint(path);
+        mAcceptor.open(endpoint.protocol());
+        mAcceptor.bind(endpoint);
+        mAcceptor.listen();
+    }
+
+    void accept(io_service& service, Handler handler) override {
+        if (mShm) {
+            acceptShm(service, handler);
+            return;
+        }
+        auto stream = new SocketStream<local::stream_protocol::socket>(service);
+        mAcceptor.async_accept(stream->socket(), [stream, handler](const error_code& ec) {
+            handler(ec, std::unique_ptr<Stream>(stream));
+        });
+    }
+};
+
+} // anonymous namespace
+
+std::unique_ptr<Listener> listen(io_service& service, TransportType transport,
+        const std::string& host, const std::string& port, bool reusePort) {
+    if (transport == TransportType::TCP)
+        return std::unique_ptr<Listener>(new TcpListener(service, host, port, reusePort));
+    if (host.empty())
+        throw std::invalid_argument("The socket path has to be given as host");
+    return std::unique_ptr<Listener>(new UnixListener(service, host, transport == TransportType::SHM));
+}
+
+std::unique_ptr<Stream> connect(io_service& service, TransportType transport,
+        const std::string& address, const std::string& defaultPort) {
+    switch (transport) {
+    case TransportType::TCP: {
+        auto pos = address.find(':');
+        auto host = address.substr(0, pos);
+        auto port = pos == std::string::npos ? defaultPort : address.substr(pos + 1);
+        ip::tcp::resolver resolver(service);
+        auto iter = resolver.resolve(ip::tcp::resolver::query(host, port));
+        std::unique_ptr<SocketStream<ip::tcp::socket>> stream(new SocketStream<ip::tcp::socket>(service));
+        boost::asio::connect(stream->socket(), iter);
+        return stream;
+    }
+    case TransportType::UNIX: {
+        std::unique_ptr<SocketStream<local::stream_protocol::socket>> stream(
+                new SocketStream<local::stream_protocol::socket>(service));
+        stream->socket().connect(local::stream_protocol::endpoint(address));
+        return stream;
+    }
+    case TransportType::SHM: {
+        std::unique_ptr<ShmStream> stream(new ShmStream(service));
+        stream->socket().connect(local::stream_protocol::endpoint(address));
+        stream->connect();
+        return stream;
+    }
+    }
+    throw std::invalid_argument("Unknown transport");
+}
+
+} // namespace tpch
@@ -0,0 +1,264 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/detail/handler_invoke_helpers.hpp>
+#include <boost/version.hpp>
+
+namespace tpch {
+
+// how client and server exchange frames
+enum class TransportType {
+    TCP,  // host:port, also across hosts
+    UNIX, // Unix domain socket at a path
+    SHM   // shared memory rings, set up and signalled over a Unix domain socket
+};
+
+// parses tcp, unix or shm
+TransportType parseTransport(const std::string& name);
+
+/**
+ * A connected byte stream to the other side, the protocol only sees this so
+ * it does not depend on the transport. Models AsyncReadStream and
+ * AsyncWriteStream for boost::asio::async_read and async_write, a stream
+ * supports one outstanding read and one outstanding write at a time.
+ */
+class Stream {
+protected:
+    using Completion = std::function<void(const boost::system::error_code&, size_t)>;
+
+    boost::asio::io_service& mService;
+    // the buffers of the outstanding write
+    std::vector<boost::asio::const_buffer> mWriteBuffers;
+
+    Stream(boost::asio::io_service& service)
+        : mService(service)
+    {}
+
+    // calls the handler through its invocation hook, a handler wrapped by a
+    // strand runs inside of the strand this way, as does every intermediate
+    // handler of a composed operation on it
+    template<class Handler>
+    static Completion completion(Handler&& handler) {
+        auto h = std::make_shared<typename std::decay<Handler>::type>(std::forward<Handler>(handler));
+        return [h](const boost::system::error_code& ec, size_t bytes) {
+            auto call = [h, ec, bytes]() {
+                (*h)(ec, bytes);
+            };
+            boost_asio_handler_invoke_helpers::invoke(call, *h);
+        };
+    }
+
+    // reads into the buffer, at most one read is outstanding
+    virtual void readSome(boost::asio::mutable_buffer buffer, Completion completion) = 0;
+    // writes from mWriteBuffers, at most one write is outstanding
+    virtual void writeSome(Completion completion) = 0;
+public:
+    virtual ~Stream();
+
+    boost::asio::io_service& get_io_service() {
+        return mService;
+    }
+
+#if BOOST_VERSION >= 106600
+    // composed operations of newer Boost.Asio versions ask for the executor
+    using executor_type = boost::asio::io_service::executor_type;
+
+    executor_type get_executor() {
+        return mService.get_executor();
+    }
+#endif
+
+    // the handler is taken by reference, as composed operations pass
+    // themselves along with buffers that live inside of them
+
+    // reads into the first non-empty buffer only
+    template<class MutableBuffers, class Handler>
+    void async_read_some(const MutableBuffers& buffers, Handler&& handler) {
+        boost::asio::mutable_buffer buffer;
+        for (auto iter = buffers.begin(); iter != buffers.end(); ++iter) {
+            buffer = boost::asio::mutable_buffer(*iter);
+            if (boost::asio::buffer_size(buffer) > 0)
+                break;
+        }
+        readSome(buffer, completion(std::forward<Handler>(handler)));
+    }
+
+    template<class ConstBuffers, class Handler>
+    void async_write_some(const ConstBuffers& buffers, Handler&& handler) {
+        mWriteBuffers.clear();
+        for (auto iter = buffers.begin(); iter != buffers.end(); ++iter) {
+            mWriteBuffers.emplace_back(*iter);
+        }
+        writeSome(completion(std::forward<Handler>(handler)));
+    }
+
+    // closes the stream, outstanding operations complete with an error
+    virtual void close() = 0;
+};
+
+// a stream over a connected asio socket, TCP or Unix domain
+template<class Socket>
+class SocketStream : public Stream {
+    Socket mSocket;
+protected:
+    void readSome(boost::asio::mutable_buffer buffer, Completion completion) override {
+        mSocket.async_read_some(boost::asio::mutable_buffers_1(buffer), completion);
+    }
+
+    void writeSome(Completion completion) override {
+        mSocket.async_write_some(mWriteBuffers, completion);
+    }
+public:
+    SocketStream(boost::asio::io_service& service)
+        : Stream(service)
+        , mSocket(service)
+    {}
+
+    Socket& socket() {
+        return mSocket;
+    }
+
+    void close() override {
+        boost::system::error_code ec;
+        mSocket.shutdown(Socket::shutdown_both, ec);
+        mSocket.close(ec);
+    }
+};
+
+/**
+ * A stream over two single-producer single-consumer byte rings in a shared
+ * memory segment, one per direction, for client and server on the same host.
+ * The client creates the segment and passes its name over a Unix domain
+ * socket, which afterwards only carries wake ups: a side that finds its ring
+ * empty (or full) flags that it waits, and the other side sends a byte after
+ * it wrote (or read) and found the flag set. Closing the socket ends the
+ * stream.
+ */
+class ShmStream : public Stream {
+public:
+    static constexpr size_t ringSize = 4 * 1024 * 1024;
+    // of the segments clients create, the server maps no others
+    static const std::string shmNamePrefix;
+private:
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> head;     // bytes written so far
+        alignas(64) std::atomic<uint64_t> tail;     // bytes read so far
+        alignas(64) std::atomic<uint32_t> readerWaiting;
+        std::atomic<uint32_t> writerWaiting;
+        uint8_t data[ringSize];
+    };
+
+    // rings[0] carries client to server, rings[1] server to client
+    struct Segment {
+        Ring rings[2];
+    };
+
+    boost::asio::local::stream_protocol::socket mSocket;
+    Segment* mSegment = nullptr;
+    Ring* mIn = nullptr;
+    Ring* mOut = nullptr;
+
+    std::mutex mMutex;
+    boost::asio::mutable_buffer mReadBuffer;
+    Completion mRead;
+    Completion mWrite;
+    bool mWaiting = false; // a read for wake ups is outstanding
+    boost::system::error_code mError;
+    bool mCorrupt = false; // the peer wrote a head or tail outside of the ring
+    // the wake up read can still be outstanding when the stream gets
+    // destroyed, so its handler only reaches the stream through this
+    struct WakeUps {
+        std::mutex mutex;
+        ShmStream* stream = nullptr;
+        uint8_t buffer[64];
+    };
+    std::shared_ptr<WakeUps> mWakeUps;
+
+    void map(const std::string& name, bool create);
+    bool tryRead(size_t& bytes);
+    bool tryWrite(size_t& bytes);
+    void corrupted();
+    void retry();
+    void waitForPeer();
+    void wokenUp(const boost::system::error_code& ec);
+    void wakePeer();
+    void complete(Completion& completion, const boost::system::error_code& ec, size_t bytes);
+protected:
+    void readSome(boost::asio::mutable_buffer buffer, Completion completion) override;
+    void writeSome(Completion completion) override;
+public:
+    ShmStream(boost::asio::io_service& service)
+        : Stream(service)
+        , mSocket(service)
+        , mWakeUps(std::make_shared<WakeUps>())
+    {
+        mWakeUps->stream = this;
+    }
+    ~ShmStream();
+
+    boost::asio::local::stream_protocol::socket& socket() {
+        return mSocket;
+    }
+
+    // creates the segment and hands it to the server, the socket has to be connected
+    void connect();
+    // maps the segment the client announced on the accepted socket and
+    // acknowledges it, throws if the segment cannot be used
+    void accept(const std::string& name);
+
+    void close() override;
+};
+
+/**
+ * Accepts connections of a transport. A stream can be accepted onto any
+ * io_service, so one listener can feed several event loops.
+ */
+class Listener {
+public:
+    using Handler = std::function<void(const boost::system::error_code&, std::unique_ptr<Stream>)>;
+
+    virtual ~Listener();
+    virtual void accept(boost::asio::io_service& service, Handler handler) = 0;
+};
+
+// host and port are used for TCP, the path is given as host otherwise,
+// reusePort lets several TCP listeners bind the same port
+std::unique_ptr<Listener> listen(boost::asio::io_service& service, TransportType transport,
+        const std::string& host, const std::string& port, bool reusePort);
+
+// address is host[:port] for TCP and the path of the server's socket otherwise
+std::unique_ptr<Stream> connect(boost::asio::io_service& service, TransportType transport,
+        const std::string& address, const std::string& defaultPort);
+
+} // namespace tpch
@@ -0,0 +1,186 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include "UpdateSets.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <tuple>
+#include <boost/unordered_map.hpp>
+
+#include "Util.hpp"
+
+namespace tpch {
+
+namespace {
+
+StringView view(const crossbow::string& str) {
+    StringView res;
+    res.data = str.data();
+    res.length = uint32_t(str.size());
+    return res;
+}
+
+} // anonymous namespace
+
+bool loadUpdateFile(const std::string& baseDir, uint32_t updateFileIndex, std::vector<Order>& orders) {
+    std::string orderFile = baseDir + "/" + orderFilePrefix + std::to_string(updateFileIndex + 1);
+    std::string lineitemFile = baseDir + "/" + lineitemFilePrefix + std::to_string(updateFileIndex + 1);
+    if (!file_readable(orderFile) || !file_readable(lineitemFile))
+        return false;
+    std::fstream orderIn(orderFile.c_str(), std::ios_base::in);
+    std::fstream lineItemIn(lineitemFile.c_str(), std::ios_base::in);
+
+    // create order tuples
+    using order_t = std::tuple<int32_t, int32_t, char, decimal, date, crossbow::string, crossbow::string, int32_t, crossbow::string>;
+    boost::unordered_map<int32_t, size_t> orderIdToIdx;
+    getFields<order_t>(orderIn, [&] (const order_t& fields) {
+        orders.emplace_back();
+        Order &order = orders.back();
+        order.orderkey = std::get<0>(fields);
+        order.custkey = std::get<1>(fields);
+        order.orderstatus = std::get<2>(fields);
+        order.totalprice = std::get<3>(fields).value;
+        order.orderdate = std::get<4>(fields).days();
+        order.orderpriority = std::get<5>(fields);
+        order.clerk = std::get<6>(fields);
+        order.shippriority = std::get<7>(fields);
+        order.comment = std::get<8>(fields);
+        order.lineitems.reserve(7);
+        orderIdToIdx.emplace(std::make_pair(order.orderkey, orders.size()-1));
+    });
+
+    // create lineitem tuples within orders
+    using lineitem_t = std::tuple<int32_t, int32_t, int32_t, int32_t, decimal, decimal, decimal, decimal, char, char, date, date, date, crossbow::string, crossbow::string, crossbow::string>;
+    getFields<lineitem_t>(lineItemIn, [&] (const lineitem_t& fields) {
+        int32_t orderKey = std::get<0>(fields);
+        auto it = orderIdToIdx.find(orderKey);
+        if (it == orderIdToIdx.end())
+            throw std::runtime_error("No order found with orderkey " + std::to_string(orderKey) + " in " + lineitemFile);
+        Order &order = orders[it->second];
+        order.lineitems.emplace_back();
+        Lineitem &item = order.lineitems.back();
+        item.orderkey =      std::get<0>(fields);
+        item.partkey =       std::get<1>(fields);
+        item.suppkey =       std::get<2>(fields);
+        item.linenumber =    std::get<3>(fields);
+        item.quantity =      std::get<4>(fields).value;
+        item.extendedprice = std::get<5>(fields).value;
+        item.discount =      std::get<6>(fields).value;
+        item.tax =           std::get<7>(fields).value;
+        item.returnflag =    std::get<8>(fields);
+        item.linestatus =    std::get<9>(fields);
+        item.shipdate =      std::get<10>(fields).days();
+        item.commitdate =    std::get<11>(fields).days();
+        item.receiptdate =   std::get<12>(fields).days();
+        item.shipinstruct =  std::get<13>(fields);
+        item.shipmode =      std::get<14>(fields);
+        item.comment =       std::get<15>(fields);
+    });
+    return true;
+}
+
+UpdateSets::UpdateSets(const std::string& baseDir) {
+    while (true) {
+        std::unique_ptr<UpdateSet> set(new UpdateSet());
+        if (!loadUpdateFile(baseDir, uint32_t(mSets.size()), set->orders))
+            break;
+
+        // the views of the lineitems of all orders share one array like in
+        // a received request, so it must not grow while they are taken
+        size_t numLineitems = 0;
+        for (auto& order : set->orders)
+            numLineitems += order.lineitems.size();
+        set->lineitemViews.reserve(numLineitems);
+        set->orderViews.reserve(set->orders.size());
+        for (auto& order : set->orders) {
+            auto firstLineitem = set->lineitemViews.size();
+            for (auto& item : order.lineitems) {
+                set->lineitemViews.emplace_back();
+                auto& line = set->lineitemViews.back();
+                line.orderkey = item.orderkey;
+                line.partkey = item.partkey;
+                line.suppkey = item.suppkey;
+                line.linenumber = item.linenumber;
+                line.quantity = item.quantity;
+                line.extendedprice = item.extendedprice;
+                line.discount = item.discount;
+                line.tax = item.tax;
+                line.returnflag = item.returnflag;
+                line.linestatus = item.linestatus;
+                line.shipdate = item.shipdate;
+                line.commitdate = item.commitdate;
+                line.receiptdate = item.receiptdate;
+                line.shipinstruct = view(item.shipinstruct);
+                line.shipmode = view(item.shipmode);
+                line.comment = view(item.comment);
+            }
+            set->orderViews.emplace_back();
+            auto& o = set->orderViews.back();
+            o.orderkey = order.orderkey;
+            o.custkey = order.custkey;
+            o.orderstatus = order.orderstatus;
+            o.totalprice = order.totalprice;
+            o.orderdate = order.orderdate;
+            o.orderpriority = view(order.orderpriority);
+            o.clerk = view(order.clerk);
+            o.shippriority = order.shippriority;
+            o.comment = view(order.comment);
+            o.lineitems = ArrayView<LineitemView>(set->lineitemViews.data() + firstLineitem,
+                    set->lineitemViews.data() + set->lineitemViews.size());
+        }
+        mSets.emplace_back(std::move(set));
+    }
+}
+
+size_t UpdateSets::numOrders() const {
+    size_t res = 0;
+    for (auto& set : mSets)
+        res += set->orders.size();
+    return res;
+}
+
+ArrayView<OrderView> UpdateSets::resolve(const RF1RefIn& ref, Arena& arena) const {
+    if (ref.updateFile >= mSets.size())
+        throw std::out_of_range("No update file " + std::to_string(ref.updateFile + 1) + " on the server");
+    auto& orders = mSets[ref.updateFile]->orderViews;
+    if (ref.count == 0 || ref.first >= orders.size() || ref.count > orders.size())
+        throw std::out_of_range("Update file " + std::to_string(ref.updateFile + 1) + " has no orders "
+                + std::to_string(ref.first) + " to " + std::to_string(size_t(ref.first) + ref.count));
+    auto first = orders.data() + ref.first;
+    if (size_t(ref.first) + ref.count <= orders.size())
+        return ArrayView<OrderView>(first, first + ref.count);
+    auto tail = orders.size() - ref.first;
+    auto res = arena.allocate<OrderView>(ref.count);
+    std::copy(first, first + tail, res);
+    std::copy(orders.data(), orders.data() + (ref.count - tail), res + tail);
+    return ArrayView<OrderView>(res, res + ref.count);
+}
+
+RF1InView::RF1InView(std::shared_ptr<Arena> arena, const UpdateSets& sets, const RF1RefIn& ref)
+    : mArena(std::move(arena))
+{
+    orders = sets.resolve(ref, *mArena);
+}
+
+} // namespace tpch
@@ -0,0 +1,76 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Arena.hpp"
+#include "Protocol.hpp"
+
+namespace tpch {
+
+static const std::string orderFilePrefix = "orders.tbl.u";
+static const std::string lineitemFilePrefix = "lineitem.tbl.u";
+
+// appends the orders of update file updateFileIndex + 1 in baseDir to orders,
+// in the order of the file and with their lineitems, returns false if one of
+// its files does not exist
+bool loadUpdateFile(const std::string& baseDir, uint32_t updateFileIndex, std::vector<Order>& orders);
+
+/**
+ * The update files of a base directory, loaded once by the server so that
+ * clients can name a range of orders of an update file (RF1_REF) instead of
+ * sending them. Read-only once loaded, so all connections share it.
+ */
+class UpdateSets {
+    struct UpdateSet {
+        std::vector<Order> orders;
+        // point into orders
+        std::vector<OrderView> orderViews;
+        std::vector<LineitemView> lineitemViews;
+    };
+    std::vector<std::unique_ptr<UpdateSet>> mSets;
+public:
+    // loads the update files 1, 2, ... of baseDir as long as they exist
+    explicit UpdateSets(const std::string& baseDir);
+
+    // number of update files
+    size_t size() const {
+        return mSets.size();
+    }
+
+    // of all update files
+    size_t numOrders() const;
+
+    /**
+     * The count orders of an update file from first on, wrapping around at
+     * its end like the client does. They are only copied into the arena if
+     * they wrap around. Throws std::out_of_range for a range the update file
+     * does not have.
+     */
+    ArrayView<OrderView> resolve(const RF1RefIn& ref, Arena& arena) const;
+};
+
+} // namespace tpch
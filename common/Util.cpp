@@ -24,7 +24,9 @@
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 #include <chrono>
+#include <stdexcept>
 #include "boost/date_time/posix_time/posix_time.hpp"
 namespace tpch {
 
@@ -39,6 +41,29 @@ std::vector<std::string> split(const std::string& str, const char delim) {
     return result;
 }
 
+decimal::decimal(const std::string& str)
+    : value(0)
+{
+    bool negative = !str.empty() && str[0] == '-';
+    int fractionDigits = -1;
+    for (size_t i = negative ? 1 : 0; i < str.size() && fractionDigits < 2; ++i) {
+        if (str[i] == '.') {
+            fractionDigits = 0;
+            continue;
+        }
+        if (str[i] < '0' || str[i] > '9')
+            throw std::invalid_argument("Invalid decimal " + str);
+        value = value * 10 + (str[i] - '0');
+        if (fractionDigits >= 0)
+            ++fractionDigits;
+    }
+    for (fractionDigits = std::max(fractionDigits, 0); fractionDigits < 2; ++fractionDigits) {
+        value *= 10;
+    }
+    if (negative)
+        value = -value;
+}
+
 uint64_t convertSqlDateToMilliSecs(const std::string& dateString)
 {
     using namespace boost::posix_time;
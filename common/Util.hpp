@@ -39,12 +39,20 @@ namespace tpch {
 // splitting strings
 std::vector<std::string> split(const std::string& str, const char delim);
 
+constexpr int64_t millisPerDay = 24 * 60 * 60 * 1000;
+
 // struct for handling dates
 struct date {
     int64_t value;
 
     date() : value(0) {}
 
+    static date fromDays(int32_t days) {
+        date result;
+        result.value = days * millisPerDay;
+        return result;
+    }
+
     date(const std::string& str) {
         using namespace boost::posix_time;
         ptime epoch(boost::gregorian::date(1970, 1, 1));
@@ -55,6 +63,27 @@ struct date {
     operator int64_t() const {
         return value;
     }
+
+    // days since 1.1.1970
+    int32_t days() const {
+        return int32_t(value / millisPerDay);
+    }
+};
+
+// fixed point decimal with the two fractional digits of all TPC-H decimals
+struct decimal {
+    int64_t value; // in hundredths
+
+    decimal() : value(0) {}
+
+    explicit decimal(int64_t hundredths) : value(hundredths) {}
+
+    // parses the string exactly instead of rounding a double
+    decimal(const std::string& str);
+
+    double toDouble() const {
+        return double(value) / 100;
+    }
 };
 
 // converts a SqlDate (with timestamp) to millisecos since 1.1.1970.
@@ -88,6 +117,21 @@ struct tpch_caster<date> {
     }
 };
 
+template<>
+struct tpch_caster<decimal> {
+    decimal operator() (std::string&& str) const {
+        return decimal(str);
+    }
+};
+
+// one character flags
+template<>
+struct tpch_caster<char> {
+    char operator() (std::string&& str) const {
+        return str.empty() ? ' ' : str[0];
+    }
+};
+
 template<>
 struct tpch_caster<std::string> {
     std::string operator() (std::string&& str) const {
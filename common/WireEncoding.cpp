@@ -0,0 +1,71 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include "WireEncoding.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace tpch {
+
+namespace {
+
+const char* const shipinstructValues[] = {"DELIVER IN PERSON", "COLLECT COD", "NONE", "TAKE BACK RETURN"};
+const char* const shipmodeValues[] = {"REG AIR", "AIR", "RAIL", "SHIP", "TRUCK", "MAIL", "FOB"};
+const char* const orderpriorityValues[] = {"1-URGENT", "2-HIGH", "3-MEDIUM", "4-NOT SPECIFIED", "5-LOW"};
+
+const char clerkPrefix[] = "Clerk#";
+constexpr size_t clerkPrefixLength = sizeof(clerkPrefix) - 1;
+
+} // anonymous namespace
+
+const Dictionary shipinstructDictionary{shipinstructValues, 4};
+const Dictionary shipmodeDictionary{shipmodeValues, 7};
+const Dictionary orderpriorityDictionary{orderpriorityValues, 5};
+
+uint32_t Dictionary::code(const char* data, size_t length) const {
+    for (uint32_t i = 0; i < size; ++i) {
+        if (std::strlen(values[i]) == length && std::memcmp(values[i], data, length) == 0)
+            return i + 1;
+    }
+    return 0;
+}
+
+uint32_t clerkCode(const char* data, size_t length) {
+    if (length != clerkLength || std::memcmp(data, clerkPrefix, clerkPrefixLength) != 0)
+        return 0;
+    uint32_t number = 0;
+    for (auto i = clerkPrefixLength; i < length; ++i) {
+        if (data[i] < '0' || data[i] > '9')
+            return 0;
+        number = number * 10 + uint32_t(data[i] - '0');
+    }
+    return number + 1;
+}
+
+void clerkName(uint32_t code, char* name) {
+    char buffer[clerkLength + 1];
+    std::snprintf(buffer, sizeof(buffer), "%s%09u", clerkPrefix, code - 1);
+    std::memcpy(name, buffer, clerkLength);
+}
+
+} // namespace tpch
@@ -0,0 +1,150 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <crossbow/string.hpp>
+
+namespace tpch {
+
+// how RF1 batches are encoded on the wire, negotiated per connection
+enum class WireEncoding : uint32_t {
+    CROSSBOW = 0, // the crossbow serialization of RF1In
+    COMPACT = 1   // see CompactEncoder
+};
+
+constexpr uint32_t encodingBit(WireEncoding encoding) {
+    return uint32_t(1) << uint32_t(encoding);
+}
+
+// negotiated along with the encoding, the client may send LZ4 compressed
+// frames (see Compression.hpp)
+constexpr uint32_t compressedFramesBit = uint32_t(1) << 31;
+
+// the values of a low-cardinality text column, a value is sent as its index
+// plus one and 0 announces a literal
+struct Dictionary {
+    const char* const* values;
+    uint32_t size;
+
+    uint32_t code(const char* data, size_t length) const;
+};
+
+extern const Dictionary shipinstructDictionary;
+extern const Dictionary shipmodeDictionary;
+extern const Dictionary orderpriorityDictionary;
+
+// clerks are named Clerk# and nine digits, which get sent as their number
+// plus one, 0 announces a literal
+uint32_t clerkCode(const char* data, size_t length);
+constexpr size_t clerkLength = 15;
+void clerkName(uint32_t code, char* name);
+
+/**
+ * Encodes an RF1In compactly, about half the size of the crossbow encoding:
+ * keys, counts and decimals (in hundredths) are varints, signed ones zigzag
+ * encoded, dates are day numbers relative to a date of the same order, the
+ * lineitem orderkey is relative to the one of its order, and text columns
+ * with few values are dictionary codes. Comments are sent as they are.
+ * Writer has to provide write(const void*, size_t).
+ */
+template<class Writer>
+class CompactEncoder {
+    Writer& mWriter;
+
+    void varint(uint64_t value) {
+        uint8_t buffer[10];
+        size_t size = 0;
+        while (value >= 0x80) {
+            buffer[size++] = uint8_t(value) | 0x80;
+            value >>= 7;
+        }
+        buffer[size++] = uint8_t(value);
+        mWriter.write(buffer, size);
+    }
+
+    void signedVarint(int64_t value) {
+        varint((uint64_t(value) << 1) ^ uint64_t(value >> 63));
+    }
+
+    void string(const crossbow::string& str) {
+        varint(str.size());
+        mWriter.write(str.data(), str.size());
+    }
+
+    void text(const Dictionary& dictionary, const crossbow::string& str) {
+        auto code = dictionary.code(str.data(), str.size());
+        varint(code);
+        if (code == 0)
+            string(str);
+    }
+
+    void clerk(const crossbow::string& str) {
+        auto code = clerkCode(str.data(), str.size());
+        varint(code);
+        if (code == 0)
+            string(str);
+    }
+public:
+    CompactEncoder(Writer& writer)
+        : mWriter(writer)
+    {}
+
+    template<class In>
+    void operator() (const In& in) {
+        varint(in.orders.size());
+        for (auto& order : in.orders) {
+            varint(uint32_t(order.orderkey));
+            varint(uint32_t(order.custkey));
+            mWriter.write(&order.orderstatus, 1);
+            signedVarint(order.totalprice);
+            signedVarint(order.orderdate);
+            text(orderpriorityDictionary, order.orderpriority);
+            clerk(order.clerk);
+            signedVarint(order.shippriority);
+            string(order.comment);
+            varint(order.lineitems.size());
+            for (auto& line : order.lineitems) {
+                signedVarint(int64_t(line.orderkey) - order.orderkey);
+                varint(uint32_t(line.partkey));
+                varint(uint32_t(line.suppkey));
+                varint(uint32_t(line.linenumber));
+                signedVarint(line.quantity);
+                signedVarint(line.extendedprice);
+                signedVarint(line.discount);
+                signedVarint(line.tax);
+                mWriter.write(&line.returnflag, 1);
+                mWriter.write(&line.linestatus, 1);
+                signedVarint(int64_t(line.shipdate) - order.orderdate);
+                signedVarint(int64_t(line.commitdate) - order.orderdate);
+                signedVarint(int64_t(line.receiptdate) - line.shipdate);
+                text(shipinstructDictionary, line.shipinstruct);
+                text(shipmodeDictionary, line.shipmode);
+                string(line.comment);
+            }
+        }
+    }
+};
+
+} // namespace tpch
@@ -0,0 +1,115 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include "AdmissionControl.hpp"
+
+#include <algorithm>
+
+namespace tpch {
+
+namespace {
+
+// the limit a controller starts with, unless the maximum is lower
+constexpr double initialLimit = 8;
+// of the limit once the storage is congested
+constexpr double decreaseFactor = 0.7;
+
+} // anonymous namespace
+
+AdmissionController::AdmissionController(size_t maxLimit, std::chrono::microseconds targetLatency,
+        double maxAbortRate)
+    : mMaxLimit(double(std::max(maxLimit, size_t(1))))
+    , mTargetLatency(targetLatency)
+    , mMaxAbortRate(maxAbortRate)
+    , mLimit(std::min(initialLimit, mMaxLimit))
+{}
+
+void AdmissionController::admit(boost::asio::io_service& service, std::function<void()> start) {
+    {
+        std::lock_guard<std::mutex> _(mMutex);
+        ++mRequested;
+        if (mInFlight >= size_t(mLimit)) {
+            mSaturated = true;
+            ++mQueued;
+            mWaiting.emplace_back(Waiting{&service, std::move(start)});
+            return;
+        }
+        ++mInFlight;
+        if (mInFlight >= size_t(mLimit))
+            mSaturated = true;
+    }
+    start();
+}
+
+void AdmissionController::complete(std::chrono::steady_clock::duration latency, bool aborted) {
+    std::lock_guard<std::mutex> _(mMutex);
+    // more in flight than the limit allows only happens after a decrease,
+    // this attempt then ran under the old limit
+    if (mInFlight <= size_t(mLimit)) {
+        ++mSamples;
+        if (aborted)
+            ++mAborts;
+        mLatency += latency;
+        if (mSamples >= size_t(mLimit))
+            adjust();
+    }
+    --mInFlight;
+    startWaiting();
+}
+
+void AdmissionController::adjust() {
+    auto congested = mLatency / mSamples > mTargetLatency || double(mAborts) > mMaxAbortRate * double(mSamples);
+    if (congested) {
+        mLimit = std::max(1.0, mLimit * decreaseFactor);
+        ++mDecreases;
+    } else if (mSaturated && mLimit < mMaxLimit) {
+        // only a limit that held transactions back is worth raising
+        mLimit = std::min(mMaxLimit, mLimit + 1);
+        ++mIncreases;
+    }
+    mSamples = 0;
+    mAborts = 0;
+    mLatency = std::chrono::steady_clock::duration(0);
+    mSaturated = mInFlight >= size_t(mLimit);
+}
+
+void AdmissionController::startWaiting() {
+    while (!mWaiting.empty() && mInFlight < size_t(mLimit)) {
+        ++mInFlight;
+        auto& waiting = mWaiting.front();
+        waiting.service->post(std::move(waiting.start));
+        mWaiting.pop_front();
+    }
+}
+
+std::string AdmissionController::report() {
+    std::lock_guard<std::mutex> _(mMutex);
+    return "Admission: limit " + std::to_string(size_t(mLimit)) + ", "
+        + std::to_string(mInFlight) + " in flight, "
+        + std::to_string(mWaiting.size()) + " waiting, "
+        + std::to_string(mRequested) + " requested, "
+        + std::to_string(mQueued) + " queued, "
+        + std::to_string(mIncreases) + " increases, "
+        + std::to_string(mDecreases) + " decreases";
+}
+
+} // namespace tpch
@@ -0,0 +1,90 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include <boost/asio.hpp>
+
+namespace tpch {
+
+/**
+ * Limits the refresh transactions all connections run at once,
+ * so the storage is kept at the knee of its throughput instead of being
+ * driven past it, where latency only grows and conflicts pile up. Requests
+ * beyond the limit wait in a queue. The limit follows additive
+ * increase/multiplicative decrease: after every window of about limit
+ * completed transactions it shrinks if their mean latency exceeded the
+ * target or too many of them aborted, and otherwise grows by one if the
+ * limit was reached during the window. After a decrease the attempts
+ * admitted under the old limit are not sampled until the in-flight count
+ * drained to the new limit, else they would cut it again right away.
+ * Populates are not limited, they run far longer than any refresh.
+ */
+class AdmissionController {
+    struct Waiting {
+        boost::asio::io_service* service;
+        std::function<void()> start;
+    };
+
+    const double mMaxLimit;
+    const std::chrono::steady_clock::duration mTargetLatency;
+    const double mMaxAbortRate;
+    std::mutex mMutex;
+    double mLimit;
+    size_t mInFlight = 0;
+    std::deque<Waiting> mWaiting;
+    // transactions completed in the current window
+    size_t mSamples = 0;
+    size_t mAborts = 0;
+    std::chrono::steady_clock::duration mLatency{0};
+    bool mSaturated = false;
+    // totals since the start
+    uint64_t mRequested = 0;
+    uint64_t mQueued = 0;
+    uint64_t mIncreases = 0;
+    uint64_t mDecreases = 0;
+
+    // has to be called with mMutex held
+    void adjust();
+    void startWaiting();
+public:
+    AdmissionController(size_t maxLimit, std::chrono::microseconds targetLatency, double maxAbortRate);
+
+    // calls start right away if the limit allows it, otherwise posts it to
+    // service once enough transactions completed
+    void admit(boost::asio::io_service& service, std::function<void()> start);
+
+    // an admitted transaction attempt finished, its latency and whether it
+    // aborted drive the limit
+    void complete(std::chrono::steady_clock::duration latency, bool aborted);
+
+    // one line with the current limit and the totals since the start
+    std::string report();
+};
+
+} // namespace tpch
@@ -23,7 +23,11 @@
 #include "Connection.hpp"
 
 #include <telldb/Transaction.hpp>
+#include <unordered_map>
+#include <boost/asio/steady_timer.hpp>
 #include "Transactions.hpp"
+#include "AdmissionControl.hpp"
+#include "GroupCommit.hpp"
 
 using namespace boost::asio;
 
@@ -38,29 +42,49 @@ class CommandImpl<TellClient> {
     server::Server<CommandImpl<TellClient>> mServer;
     boost::asio::io_service& mService;
     TellClient mClient;
-    std::unique_ptr<tell::db::TransactionFiber<void>> mFiber;
+    // fibers of the running transactions by id
+    std::unordered_map<uint64_t, std::unique_ptr<tell::db::TransactionFiber<void>>> mFibers;
+    uint64_t mNextFiber = 0;
+    TableCache<Transactions::CachedTable>& mTables;
     Transactions mTransactions;
+    GroupCommitter* mGroupCommitter;
+    AdmissionController* mAdmission;
+    const RetryPolicy& mRetryPolicy;
+    RefreshStats& mStats;
     DBGenerator<TellClient, TellFiber> &mGenerator;
+    const SchemaOptions& mSchemaOptions;
+    std::function<void()> mStop;
 
 public:
     CommandImpl(
             Connection<TellClient, TellFiber> *connection,
-            boost::asio::ip::tcp::socket& socket,
+            Stream& stream,
             boost::asio::io_service& service,
-            TellClient client,
-            DBGenerator<TellClient, TellFiber> &generator
+            ServerContext<TellClient, TellFiber>& context
     )
         : mConnection(connection)
-        , mServer(*this, socket)
+        , mServer(*this, stream, context.maxInFlight, context.updateSets.get())
         , mService(service)
-        , mClient(client)
-        , mGenerator(generator)
+        , mClient(context.client)
+        , mTables(context.tables)
+        , mTransactions(mTables, context.schemaOptions)
+        , mGroupCommitter(context.groupCommitter.get())
+        , mAdmission(context.admission.get())
+        , mRetryPolicy(context.retryPolicy)
+        , mStats(context.stats)
+        , mGenerator(context.generator)
+        , mSchemaOptions(context.schemaOptions)
+        , mStop(context.stop)
     {}
 
     void run() {
         mServer.run();
     }
 
+    void stop() {
+        mStop();
+    }
+
     void close() {
          delete mConnection;
     }
@@ -71,12 +95,13 @@ public:
         bool success;
         crossbow::string msg;
         try {
-            mGenerator.createSchema(mClient, args, 0);
+            mGenerator.createSchema(mClient, args, mSchemaOptions);
             success = true;
         } catch (std::exception& ex) {
             success = false;
             msg = ex.what();
         }
+        mTables.clear();
         callback(std::make_tuple(success, msg));
     }
 
@@ -89,7 +114,7 @@ public:
         const crossbow::string &baseDir = std::get<1>(args);
         std::string bd (baseDir.c_str(), baseDir.size());
         try {
-            mGenerator.populate(mClient, bd, partIndex);
+            mGenerator.populate(mClient, bd, partIndex, mSchemaOptions);
             success = true;
         } catch (std::exception& ex) {
             success = false;
@@ -107,40 +132,90 @@ public:
 
     template<Command C, class Callback>
     typename std::enable_if<C == Command::RF1, void>::type
-    execute(const typename Signature<C>::arguments& args, const Callback& callback) {
+    execute(const typename RequestArguments<C>::type& args, const Callback& callback) {
         LOG_DEBUG("Received RF1 event at Tell Connection.");
-        auto transaction = [this, args, callback](tell::db::Transaction& tx) {
-            typename Signature<C>::result res = mTransactions.rf1(tx, args);
-            mService.post([this, res, callback]() {
-                mFiber->wait();
-                mFiber.reset(nullptr);
-                callback(res);
-            });
-        };
-        mFiber.reset(new tell::db::TransactionFiber<void>(mClient->clientManager.startTransaction(transaction)));
+        if (mGroupCommitter) {
+            mGroupCommitter->rf1(mService, args, callback);
+            return;
+        }
+        runTransaction<C>(args, callback, 1, std::chrono::steady_clock::now());
     }
 
     template<Command C, class Callback>
     typename std::enable_if<C == Command::RF2, void>::type
-    execute(const typename Signature<C>::arguments& args, const Callback& callback) {
+    execute(const typename RequestArguments<C>::type& args, const Callback& callback) {
         LOG_DEBUG("Received RF2 event at Tell Connection.");
-        auto transaction = [this, args, callback](tell::db::Transaction& tx) {
-            typename Signature<C>::result res = mTransactions.rf2(tx, args);
-            mService.post([this, res, callback]() {
-                mFiber->wait();
-                mFiber.reset(nullptr);
+        if (mGroupCommitter) {
+            mGroupCommitter->rf2(mService, args, callback);
+            return;
+        }
+        runTransaction<C>(args, callback, 1, std::chrono::steady_clock::now());
+    }
+
+private:
+    RF1Out apply(tell::db::Transaction& tx, const RF1InView& args) {
+        return mTransactions.rf1(tx, args);
+    }
+
+    RF2Out apply(tell::db::Transaction& tx, const RF2InView& args) {
+        return mTransactions.rf2(tx, args);
+    }
+
+    // starts the transaction right away or once the admission controller lets it
+    template<class Start>
+    void admit(Start start) {
+        if (mAdmission) {
+            mAdmission->admit(mService, start);
+            return;
+        }
+        start();
+    }
+
+    // runs the transaction again after a backoff as long as it conflicts and
+    // the retry policy allows it, every attempt has to be admitted
+    template<Command C, class Callback>
+    void runTransaction(const typename RequestArguments<C>::type& args, const Callback& callback,
+            unsigned attempt, std::chrono::steady_clock::time_point start) {
+        admit([this, args, callback, attempt, start]() {
+            startTransaction<C>(args, callback, attempt, start);
+        });
+    }
+
+    template<Command C, class Callback>
+    void startTransaction(const typename RequestArguments<C>::type& args, const Callback& callback,
+            unsigned attempt, std::chrono::steady_clock::time_point start) {
+        auto id = mNextFiber++;
+        auto attemptStart = std::chrono::steady_clock::now();
+        auto transaction = [this, id, args, callback, attempt, start, attemptStart](tell::db::Transaction& tx) {
+            typename Signature<C>::result res = apply(tx, args);
+            mService.post([this, id, args, res, callback, attempt, start, attemptStart]() mutable {
+                auto fiber = mFibers.find(id);
+                fiber->second->wait();
+                mFibers.erase(fiber);
+                if (mAdmission)
+                    mAdmission->complete(std::chrono::steady_clock::now() - attemptStart, res.conflict);
+                if (mRetryPolicy.retry(res.conflict, attempt)) {
+                    auto timer = std::make_shared<boost::asio::steady_timer>(mService, mRetryPolicy.backoff(attempt));
+                    timer->async_wait([this, args, callback, attempt, start, timer](const boost::system::error_code&) {
+                        runTransaction<C>(args, callback, attempt + 1, start);
+                    });
+                    return;
+                }
+                res.attempts = attempt;
+                mStats.record(C, res, std::chrono::steady_clock::now() - start);
                 callback(res);
             });
         };
-        mFiber.reset(new tell::db::TransactionFiber<void>(mClient->clientManager.startTransaction(transaction)));
+        mFibers.emplace(id, std::unique_ptr<tell::db::TransactionFiber<void>>(
+                new tell::db::TransactionFiber<void>(mClient->clientManager.startTransaction(transaction))));
     }
 
 };
 
 template<>
-Connection<TellClient, TellFiber>::Connection(boost::asio::io_service& service, TellClient &client, DBGenerator<TellClient, TellFiber> &generator, int)
-    : mSocket(service)
-    , mImpl(new CommandImpl<TellClient>(this, mSocket, service, client, generator))
+Connection<TellClient, TellFiber>::Connection(std::unique_ptr<Stream> stream, ServerContext<TellClient, TellFiber>& context)
+    : mStream(std::move(stream))
+    , mImpl(new CommandImpl<TellClient>(this, *mStream, mStream->get_io_service(), context))
 {}
 
 template<>
@@ -21,6 +21,7 @@
  *     Lucas Braun <braunl@inf.ethz.ch>
  */
 #pragma once
+#include <functional>
 #include <vector>
 #include <boost/asio.hpp>
 #include <memory>
@@ -34,20 +35,69 @@
 #endif
 
 #include "CreatePopulate.hpp"
+#include "RefreshStats.hpp"
+#include "RetryPolicy.hpp"
+#include "TableCache.hpp"
+#include "Transactions.hpp"
+#ifdef USE_KUDU
+#include "TransactionsKudu.hpp"
+#endif
 
 namespace tpch {
 
 template <class T>
 class CommandImpl;
 
+// state shared by all connections of a server
+template <class ClientType, class FiberType>
+struct ServerContext;
+
+class AdmissionController;
+class GroupCommitter;
+class UpdateSets;
+
+template <>
+struct ServerContext<TellClient, TellFiber> {
+    TellClient client;
+    DBGenerator<TellClient, TellFiber> generator;
+    SchemaOptions schemaOptions;
+    TableCache<Transactions::CachedTable> tables;
+    RetryPolicy retryPolicy;
+    RefreshStats stats;
+    size_t maxInFlight = 1; // requests a connection executes concurrently
+    std::shared_ptr<GroupCommitter> groupCommitter; // merges RF1 and RF2 of all connections, optional
+    std::shared_ptr<const UpdateSets> updateSets; // for RF1 batches sent by reference, optional
+    std::shared_ptr<AdmissionController> admission; // limits the transactions of all connections, optional
+    std::function<void()> stop; // stops all event loops of the server, for EXIT
+};
+
+#ifdef USE_KUDU
+class KuduWorkerPool;
+
+template <>
+struct ServerContext<KuduClient, KuduFiber> {
+    KuduClient client;
+    DBGenerator<KuduClient, KuduFiber> generator;
+    SchemaOptions schemaOptions;
+    TableCache<TransactionsKudu::CachedTable> tables;
+    RetryPolicy retryPolicy;
+    RefreshStats stats;
+    size_t maxInFlight = 1; // requests a connection executes concurrently
+    std::shared_ptr<KuduWorkerPool> workers; // runs RF1 and RF2 off the network threads
+    std::shared_ptr<const UpdateSets> updateSets; // for RF1 batches sent by reference, optional
+    std::shared_ptr<AdmissionController> admission; // limits the transactions of all connections, optional
+    std::function<void()> stop; // stops all event loops of the server, for EXIT
+};
+#endif
+
 template <class ClientType, class FiberType>  // <TellClient, TellFiber> or <KuduClient, KuduFiber>
 class Connection {
-    boost::asio::ip::tcp::socket mSocket;
+    std::unique_ptr<Stream> mStream;
     std::unique_ptr<CommandImpl<ClientType>> mImpl;
 public:
-    Connection(boost::asio::io_service& service, ClientType& client, DBGenerator<ClientType, FiberType>& generator, int partitions);
+    // the connection runs on the io_service of the stream
+    Connection(std::unique_ptr<Stream> stream, ServerContext<ClientType, FiberType>& context);
     ~Connection();
-    decltype(mSocket)& socket() { return mSocket; }
     void run();
 public:
     static ClientType getClient(std::string &storage, std::string &commitMananger, size_t networkThreads);
@@ -24,8 +24,12 @@
 
 #include <crossbow/logger.hpp>
 
+#include <boost/asio/steady_timer.hpp>
+
+#include "AdmissionControl.hpp"
 #include "TransactionsKudu.hpp"
 #include "KuduUtil.hpp"
+#include "KuduWorkerPool.hpp"
 
 using namespace boost::asio;
 
@@ -37,36 +41,52 @@ Connection<KuduClient, KuduFiber>::~Connection();
 template<>
 class CommandImpl<KuduClient> {
     Connection<KuduClient, KuduFiber> *mConnection;
-    boost::asio::ip::tcp::socket& mSocket;
+    Stream& mStream;
+    boost::asio::io_service& mService;
+    boost::asio::io_service::strand mStrand;
     server::Server<CommandImpl<KuduClient>> mServer;
     KuduClient &mClient;
-    Session mSession;
+    KuduWorkerPool& mWorkers;
+    AdmissionController* mAdmission;
+    TableCache<TransactionsKudu::CachedTable>& mTables;
     TransactionsKudu mTransactions;
+    const RetryPolicy& mRetryPolicy;
+    RefreshStats& mStats;
     DBGenerator<KuduClient, KuduFiber> &mGenerator;
-    const int mPartitions;
+    const SchemaOptions& mSchemaOptions;
+    std::function<void()> mStop;
 
 public:
     CommandImpl(Connection<KuduClient, KuduFiber> *connection,
-                boost::asio::ip::tcp::socket& socket,
-                KuduClient &client,
-                DBGenerator<KuduClient, KuduFiber> &generator,
-                int partitions)
+                Stream& stream,
+                boost::asio::io_service& service,
+                ServerContext<KuduClient, KuduFiber>& context)
         : mConnection(connection)
-        , mSocket(socket)
-        , mServer(*this, mSocket)
-        , mClient(client)
-        , mSession(client->NewSession())
-        , mGenerator(generator)
-        , mPartitions(partitions)
+        , mStream(stream)
+        , mService(service)
+        , mStrand(service)
+        , mServer(*this, mStream, context.maxInFlight, context.updateSets.get())
+        , mClient(context.client)
+        , mWorkers(*context.workers)
+        , mAdmission(context.admission.get())
+        , mTables(context.tables)
+        , mTransactions(mTables, context.schemaOptions)
+        , mRetryPolicy(context.retryPolicy)
+        , mStats(context.stats)
+        , mGenerator(context.generator)
+        , mSchemaOptions(context.schemaOptions)
+        , mStop(context.stop)
     {
-        assertOk(mSession->SetFlushMode(kudu::client::KuduSession::MANUAL_FLUSH));
-        mSession->SetTimeoutMillis(60000);
     }
 
     void run() {
         mServer.run();
     }
 
+    void stop() {
+        mStop();
+    }
+
     void close() {
         delete mConnection;
     }
@@ -77,12 +97,13 @@ public:
         bool success;
         crossbow::string msg;
         try {
-            mGenerator.createSchema(mClient, args, mPartitions);
+            mGenerator.createSchema(mClient, args, mSchemaOptions);
             success = true;
         } catch (std::exception& ex) {
             success = false;
             msg = ex.what();
         }
+        mTables.clear();
         callback(std::make_tuple(success, msg));
     }
 
@@ -95,7 +116,7 @@ public:
         const crossbow::string &baseDir = std::get<1>(args);
         std::string bd (baseDir.c_str(), baseDir.size());
         try {
-            mGenerator.populate(mClient, bd, partIndex);
+            mGenerator.populate(mClient, bd, partIndex, mSchemaOptions);
             success = true;
         } catch (std::exception& ex) {
             success = false;
@@ -113,23 +134,76 @@ public:
 
     template<Command C, class Callback>
     typename std::enable_if<C == Command::RF1, void>::type
-    execute(const typename Signature<C>::arguments& args, const Callback& callback) {
+    execute(const typename RequestArguments<C>::type& args, const Callback& callback) {
         LOG_DEBUG("Received RF1 event at Kudu Connection.");
-        callback(mTransactions.rf1(*mSession, args));
+        runTransaction<C>(args, callback, 1, std::chrono::steady_clock::now());
     }
 
     template<Command C, class Callback>
     typename std::enable_if<C == Command::RF2, void>::type
-    execute(const typename Signature<C>::arguments& args, const Callback& callback) {
-       LOG_DEBUG("Received RF2 event at Kudu Connection.");
-       callback(mTransactions.rf2(*mSession, args));
+    execute(const typename RequestArguments<C>::type& args, const Callback& callback) {
+        LOG_DEBUG("Received RF2 event at Kudu Connection.");
+        runTransaction<C>(args, callback, 1, std::chrono::steady_clock::now());
+    }
+
+private:
+    RF1Out apply(kudu::client::KuduSession& session, const RF1InView& args) {
+        return mTransactions.rf1(session, args);
+    }
+
+    RF2Out apply(kudu::client::KuduSession& session, const RF2InView& args) {
+        return mTransactions.rf2(session, args);
+    }
+
+    // starts the transaction right away or once the admission controller lets it
+    template<class Start>
+    void admit(Start start) {
+        if (mAdmission) {
+            mAdmission->admit(mService, start);
+            return;
+        }
+        start();
+    }
+
+    // runs the transaction again after a backoff as long as it fails with a
+    // transient error and the retry policy allows it, every attempt has to be
+    // admitted
+    template<Command C, class Callback>
+    void runTransaction(const typename RequestArguments<C>::type& args, const Callback& callback,
+            unsigned attempt, std::chrono::steady_clock::time_point start) {
+        admit([this, args, callback, attempt, start]() {
+            startTransaction<C>(args, callback, attempt, start);
+        });
+    }
+
+    template<Command C, class Callback>
+    void startTransaction(const typename RequestArguments<C>::type& args, const Callback& callback,
+            unsigned attempt, std::chrono::steady_clock::time_point start) {
+        auto attemptStart = std::chrono::steady_clock::now();
+        mWorkers.post([this, args, callback, attempt, start, attemptStart](kudu::client::KuduSession& session) {
+            typename Signature<C>::result res = apply(session, args);
+            if (mAdmission)
+                mAdmission->complete(std::chrono::steady_clock::now() - attemptStart, res.conflict);
+            mStrand.post([this, args, res, callback, attempt, start]() mutable {
+                if (mRetryPolicy.retry(res.conflict, attempt)) {
+                    auto timer = std::make_shared<boost::asio::steady_timer>(mService, mRetryPolicy.backoff(attempt));
+                    timer->async_wait([this, args, callback, attempt, start, timer](const boost::system::error_code&) {
+                        runTransaction<C>(args, callback, attempt + 1, start);
+                    });
+                    return;
+                }
+                res.attempts = attempt;
+                mStats.record(C, res, std::chrono::steady_clock::now() - start);
+                callback(res);
+            });
+        });
     }
 };
 
 template<>
-Connection<KuduClient, KuduFiber>::Connection(boost::asio::io_service& service, KuduClient &client, DBGenerator<KuduClient, KuduFiber> &generator, int partitions)
-    : mSocket(service)
-    , mImpl(new CommandImpl<KuduClient>(this, mSocket, client, generator, partitions))
+Connection<KuduClient, KuduFiber>::Connection(std::unique_ptr<Stream> stream, ServerContext<KuduClient, KuduFiber>& context)
+    : mStream(std::move(stream))
+    , mImpl(new CommandImpl<KuduClient>(this, *mStream, mStream->get_io_service(), context))
 {}
 
 template<>
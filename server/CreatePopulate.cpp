@@ -22,6 +22,8 @@
  */
 #include "CreatePopulate.hpp"
 
+#include <algorithm>
+
 namespace tpch {
 
 using namespace tell::db;
@@ -30,10 +32,13 @@ template<>
 struct TableCreator<Transaction> {
     Transaction& tx;
     tell::store::Schema schema;
+    const std::unordered_set<std::string>& indexes;
+    bool naturalKey = false;
 
-    TableCreator(Transaction& tx)
+    TableCreator(Transaction& tx, const SchemaOptions& options)
         : tx(tx)
         , schema(tell::store::TableType::TRANSACTIONAL)
+        , indexes(options.indexes)
     {}
 
     template<class S>
@@ -61,106 +66,127 @@ struct TableCreator<Transaction> {
         }
     }
 
-    void create(const std::string& name, double scalingFactor, int partitions) {
+    template<class S>
+    void operator() (const S& name, type t, encoding, compression = compression::DEFAULT, bool notNull = true) {
+        // TellStore chooses the storage format itself
+        (*this)(name, t, notNull);
+    }
+
+    void create(const std::string& name, double scalingFactor) {
         tx.createTable(name, schema);
+        if (!naturalKey)
+            tx.createCounter(name + "_counter");
     }
 
-    void setPrimaryKey(const std::vector<std::string>& fieldNames) {
-        // we do not explicitely set the primary key on tell, but we misuse the
-        // function here to create addtional counters for all tables as well as
-        // an additional index for lineitem and orders
-        char firstChar = fieldNames[0][0];
-        switch (firstChar) {
-        case 'p':
-            if (fieldNames[0][1] == 's') {
-                tx.createCounter("partsupp_counter");
-            } else {
-                tx.createCounter("part_counter");
-            }
-            break;
-        case 's':
-            tx.createCounter("supplier_counter");
-            break;
-        case 'c':
-            tx.createCounter("customer_counter");
-            break;
-        case 'o':
-            schema.addIndex("o_orderkey_idx",
-                std::make_pair(true, std::vector<tell::store::Schema::id_t>{
-                    schema.idOf("o_orderkey")
-                }));
-            tx.createCounter("orders_counter");
-            break; 
-        case 'l':
-            schema.addIndex("l_orderkey_idx",
-                    std::make_pair(false, std::vector<tell::store::Schema::id_t>{
-                         schema.idOf("l_orderkey")
-                    }));
-            tx.createCounter("lineitem_counter");
-            break;
-        case 'n':
-            tx.createCounter("nation_counter");
-            break;
-        case 'r':
-            tx.createCounter("region_counter");
-            break;
+    void setPrimaryKey(const std::vector<std::string>&) {
+        // tuples are keyed by a counter per table, uniqueness of the primary
+        // key is not enforced
+    }
+
+    // tuples are keyed by their primary key instead of a counter, see
+    // orderTupleKey and lineitemTupleKey
+    void useNaturalKey() {
+        naturalKey = true;
+    }
+
+    void addIndex(const IndexSpec& index) {
+        if (index.optional && indexes.count(index.name) == 0)
+            return;
+        std::vector<tell::store::Schema::id_t> fieldIds;
+        for (auto& column : index.columns) {
+            fieldIds.emplace_back(schema.idOf(column));
         }
+        schema.addIndex(index.name, std::make_pair(index.unique, std::move(fieldIds)));
     }
 };
 
 template<>
 struct Populator<Transaction> {
+    enum class KeyMode {
+        COUNTER, ORDER, LINEITEM
+    };
+
     Transaction& tx;
+    const SchemaOptions& options;
+    std::vector<crossbow::string> names;
     std::unordered_map<crossbow::string, Field> fields;
     tell::db::table_t tableId;
+    KeyMode keyMode = KeyMode::COUNTER;
     std::unique_ptr<Counter> counter;
-
-    Populator(Transaction& tx, const crossbow::string& name)
+    // positions of the natural key columns in the row
+    size_t orderkeyColumn = 0;
+    size_t linenumberColumn = 0;
+    int32_t orderkey = 0;
+    int32_t linenumber = 0;
+
+    Populator(Transaction& tx, const crossbow::string& name, const std::vector<std::string>& columns,
+            const SchemaOptions& options)
         : tx(tx)
-        , counter(new Counter(tx.getCounter(name + "_counter")))
+        , options(options)
     {
+        for (auto& column : columns) {
+            names.emplace_back(column);
+        }
+        auto columnOf = [&columns](const char* column) {
+            return size_t(std::find(columns.begin(), columns.end(), column) - columns.begin());
+        };
+        if (options.naturalKeys && name == "orders") {
+            keyMode = KeyMode::ORDER;
+            orderkeyColumn = columnOf("o_orderkey");
+        } else if (options.naturalKeys && name == "lineitem") {
+            keyMode = KeyMode::LINEITEM;
+            orderkeyColumn = columnOf("l_orderkey");
+            linenumberColumn = columnOf("l_linenumber");
+        } else {
+            counter.reset(new Counter(tx.getCounter(name + "_counter")));
+        }
         auto f = tx.openTable(name);
         tableId = f.get();
     }
 
-    template<class Str>
-    void operator() (Str&& name, int16_t val) {
-        fields.emplace(std::forward<Str>(name), val);
+    void operator() (size_t column, int16_t val) {
+        fields.emplace(names[column], val);
     }
 
-    template<class Str>
-    void operator() (Str&& name, int32_t val) {
-        fields.emplace(std::forward<Str>(name), val);
-    }
-
-    template<class Str>
-    void operator() (Str&& name, int64_t val) {
-        fields.emplace(std::forward<Str>(name), val);
+    void operator() (size_t column, int32_t val) {
+        if (keyMode != KeyMode::COUNTER) {
+            if (column == orderkeyColumn) {
+                orderkey = val;
+            } else if (keyMode == KeyMode::LINEITEM && column == linenumberColumn) {
+                linenumber = val;
+            }
+        }
+        fields.emplace(names[column], val);
     }
 
-    template<class Str>
-    void operator() (Str&& name, date d) {
-        fields.emplace(std::forward<Str>(name), d.value);
+    void operator() (size_t column, int64_t val) {
+        fields.emplace(names[column], val);
     }
 
-    template<class Str>
-    void operator() (Str&& name, float val) {
-        fields.emplace(std::forward<Str>(name), val);
+    void operator() (size_t column, double val) {
+        fields.emplace(names[column], val);
     }
 
-    template<class Str>
-    void operator() (Str&& name, double val) {
-        fields.emplace(std::forward<Str>(name), val);
+    void operator() (size_t column, const crossbow::string& val) {
+        fields.emplace(names[column], val);
     }
 
-    template<class Str1, class Str2>
-    void operator() (Str1&& name, Str2&& val) {
-        fields.emplace(std::forward<Str1>(name), std::forward<Str2>(val));
+    template<class Row>
+    void insert(const Row& row) {
+        writeRow<crossbow::string>(*this, row, options);
+        tx.insert(tableId, tell::db::key_t{nextKey()}, fields);
+        fields.clear();
     }
 
-    void apply() {
-        tx.insert(tableId, tell::db::key_t{counter->next()}, fields);
-        fields.clear();
+    uint64_t nextKey() {
+        switch (keyMode) {
+        case KeyMode::ORDER:
+            return orderTupleKey(orderkey);
+        case KeyMode::LINEITEM:
+            return lineitemTupleKey(orderkey, linenumber);
+        default:
+            return counter->next();
+        }
     }
 
     void flush() {
@@ -176,9 +202,9 @@ struct string_type<Transaction> {
     using type = crossbow::string;
 };
 
-void DBGenBase<TellClient, TellFiber>::createSchema(TellClient& client, double scalingFactor, int partitions) {
-    auto schemaFiber = client->clientManager.startTransaction([scalingFactor, partitions] (tell::db::Transaction& tx) {
-        createTables(tx, scalingFactor, partitions);
+void DBGenBase<TellClient, TellFiber>::createSchema(TellClient& client, double scalingFactor, const SchemaOptions& options) {
+    auto schemaFiber = client->clientManager.startTransaction([scalingFactor, &options] (tell::db::Transaction& tx) {
+        createTables(tx, scalingFactor, options);
         tx.commit();
     });
     schemaFiber.wait();
@@ -186,13 +212,14 @@ void DBGenBase<TellClient, TellFiber>::createSchema(TellClient& client, double s
 
 void DBGenBase<TellClient, TellFiber>::threaded_populate(TellClient &client,
         std::queue<TellFiber> &fibers,
-        std::string &tableName, const std::shared_ptr<std::stringstream> data) {
+        std::string &tableName, const std::shared_ptr<std::stringstream> data, LoadContext& context) {
     if (fibers.size() >= 28) {
         fibers.front().wait();
         fibers.pop();
     }
-    fibers.emplace(client->clientManager.startTransaction([&tableName, data] (tell::db::Transaction& tx) {
-        Populate<tell::db::Transaction> populate(tx);
+    auto& options = context.options;
+    fibers.emplace(client->clientManager.startTransaction([&tableName, data, &options] (tell::db::Transaction& tx) {
+        Populate<tell::db::Transaction> populate(tx, options);
         populateTable(tableName, data, populate);
         tx.commit();
         std::cout << '.';
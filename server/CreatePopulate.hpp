@@ -26,12 +26,17 @@
 #include <fstream>
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
+#include <array>
 #include <memory>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <telldb/TellDB.hpp>
 
 #include "common/Util.hpp"
+#include "common/Protocol.hpp"
 
 #ifdef USE_KUDU
 #include <kudu/client/client.h>
@@ -66,141 +71,524 @@ using KuduClient = std::tr1::shared_ptr<kudu::client::KuduClient>;
 using KuduFiber = std::thread;
 #endif
 
+// physical layout of the tables and how they get loaded, every server connected
+// to the same storage has to use the same layout
+struct SchemaOptions {
+    int partitions = 1;     // number of range partitions per table (Kudu)
+    int hashBuckets = 0;    // number of hash buckets on the key per table (Kudu), 0 means no hash partitioning
+    std::unordered_map<std::string, int> tableHashBuckets; // overrides hashBuckets for single tables
+    bool routedLoad = false; // buffer populate inserts per range partition before sending them (Kudu)
+    bool naturalKeys = false; // key orders and lineitem tuples by their business key instead of counters (Tell)
+    std::unordered_set<std::string> indexes; // optional secondary indexes to create (Tell)
+    bool compactTypes = false; // store dates, decimals and flags as INT days, BIGINT hundredths and SMALLINT
+
+    int hashBucketsOf(const std::string& tableName) const {
+        auto iter = tableHashBuckets.find(tableName);
+        return iter == tableHashBuckets.end() ? hashBuckets : iter->second;
+    }
+};
+
+// tuple keys of orders and lineitem if SchemaOptions::naturalKeys is set, an
+// order has at most 7 lineitems
+inline uint64_t orderTupleKey(int32_t orderkey) {
+    return uint64_t(orderkey);
+}
+
+inline uint64_t lineitemTupleKey(int32_t orderkey, int32_t linenumber) {
+    return uint64_t(orderkey) * 8 + uint64_t(linenumber);
+}
+
+// secondary index of a table, only TellStore has them. Optional indexes are
+// only created if they are listed in SchemaOptions::indexes
+struct IndexSpec {
+    std::string name;
+    bool unique;
+    std::vector<std::string> columns;
+    bool optional;
+
+    IndexSpec(std::string name, bool unique, std::vector<std::string> columns, bool optional = false)
+        : name(std::move(name))
+        , unique(unique)
+        , columns(std::move(columns))
+        , optional(optional)
+    {}
+};
+
 // private stuff
 enum class type {
     SMALLINT, INT, BIGINT, FLOAT, DOUBLE, TEXT
 };
 
+// column storage hints, only used by Kudu
+enum class encoding {
+    AUTO, PLAIN, PREFIX, RLE, DICT, BITSHUFFLE
+};
+
+enum class compression {
+    DEFAULT, NONE, SNAPPY, LZ4, ZLIB
+};
+
+// physical types of dates, decimals and one character flags, these are BIGINT
+// milliseconds, DOUBLE and TEXT or INT days, BIGINT hundredths and SMALLINT
+// character codes with SchemaOptions::compactTypes
+inline type dateType(const SchemaOptions& options) {
+    return options.compactTypes ? type::INT : type::BIGINT;
+}
+
+inline type decimalType(const SchemaOptions& options) {
+    return options.compactTypes ? type::BIGINT : type::DOUBLE;
+}
+
+inline type flagType(const SchemaOptions& options) {
+    return options.compactTypes ? type::SMALLINT : type::TEXT;
+}
+
+// call set(column, value) with the physical value of a date, decimal or flag
+// column, column is either a name or an index
+template<class Set, class Column>
+void setDate(Set& set, Column column, date value, const SchemaOptions& options) {
+    if (options.compactTypes) {
+        set(column, value.days());
+    } else {
+        set(column, value.value);
+    }
+}
+
+template<class Set, class Column>
+void setDecimal(Set& set, Column column, decimal value, const SchemaOptions& options) {
+    if (options.compactTypes) {
+        set(column, value.value);
+    } else {
+        set(column, value.toDouble());
+    }
+}
+
+template<class String, class Set, class Column>
+void setFlag(Set& set, Column column, char value, const SchemaOptions& options) {
+    if (options.compactTypes) {
+        set(column, int16_t(value));
+    } else {
+        set(column, String(1, value));
+    }
+}
+
+// a column of a table descriptor, its type follows from the row type
+struct ColumnDef {
+    const char* name;
+    encoding enc;
+    compression comp;
+
+    ColumnDef(const char* name, encoding enc = encoding::AUTO, compression comp = compression::DEFAULT)
+        : name(name)
+        , enc(enc)
+        , comp(comp)
+    {}
+};
+
+/**
+ * Table descriptors list the columns of a table in the order of the .tbl files
+ * and the C++ type of every column in row<String>. Dates, decimals and one
+ * character flags are date, decimal and char, their physical type depends on
+ * the schema profile. The descriptors drive the DDL (addColumns), the parser
+ * (Populate::populate) and the row builder (writeRow).
+ */
+struct PartTable {
+    template<class String>
+    using row = std::tuple<int32_t, String, String, String, String, int32_t, String, decimal, String>;
+    static const char* name() { return "part"; }
+    static std::vector<std::string> primaryKey() { return {"p_partkey"}; }
+    static const std::array<ColumnDef, 9>& columns() {
+        static const std::array<ColumnDef, 9> columns = {{
+            {"p_partkey"},
+            {"p_name"},
+            {"p_mfgr", encoding::DICT},
+            {"p_brand", encoding::DICT},
+            {"p_type", encoding::DICT},
+            {"p_size"},
+            {"p_container", encoding::DICT},
+            {"p_retailprice"},
+            {"p_comment", encoding::PLAIN, compression::LZ4}
+        }};
+        return columns;
+    }
+};
+
+struct SupplierTable {
+    template<class String>
+    using row = std::tuple<int32_t, String, String, int32_t, String, decimal, String>;
+    static const char* name() { return "supplier"; }
+    static std::vector<std::string> primaryKey() { return {"s_suppkey"}; }
+    static const std::array<ColumnDef, 7>& columns() {
+        static const std::array<ColumnDef, 7> columns = {{
+            {"s_suppkey"},
+            {"s_name"},
+            {"s_address"},
+            {"s_nationkey"},
+            {"s_phone"},
+            {"s_acctbal"},
+            {"s_comment", encoding::PLAIN, compression::LZ4}
+        }};
+        return columns;
+    }
+};
+
+struct PartsuppTable {
+    template<class String>
+    using row = std::tuple<int32_t, int32_t, int32_t, decimal, String>;
+    static const char* name() { return "partsupp"; }
+    static std::vector<std::string> primaryKey() { return {"ps_partkey", "ps_suppkey"}; }
+    static const std::array<ColumnDef, 5>& columns() {
+        static const std::array<ColumnDef, 5> columns = {{
+            {"ps_partkey"},
+            {"ps_suppkey"},
+            {"ps_availqty"},
+            {"ps_supplycost"},
+            {"ps_comment", encoding::PLAIN, compression::LZ4}
+        }};
+        return columns;
+    }
+};
+
+struct CustomerTable {
+    template<class String>
+    using row = std::tuple<int32_t, String, String, int32_t, String, decimal, String, String>;
+    static const char* name() { return "customer"; }
+    static std::vector<std::string> primaryKey() { return {"c_custkey"}; }
+    static const std::array<ColumnDef, 8>& columns() {
+        static const std::array<ColumnDef, 8> columns = {{
+            {"c_custkey"},
+            {"c_name"},
+            {"c_address"},
+            {"c_nationkey"},
+            {"c_phone"},
+            {"c_acctbal"},
+            {"c_mktsegment", encoding::DICT},
+            {"c_comment", encoding::PLAIN, compression::LZ4}
+        }};
+        return columns;
+    }
+};
+
+struct OrdersTable {
+    template<class String>
+    using row = std::tuple<int32_t, int32_t, char, decimal, date, String, String, int32_t, String>;
+    static const char* name() { return "orders"; }
+    static std::vector<std::string> primaryKey() { return {"o_orderkey"}; }
+    static const std::array<ColumnDef, 9>& columns() {
+        static const std::array<ColumnDef, 9> columns = {{
+            {"o_orderkey", encoding::BITSHUFFLE},
+            {"o_custkey", encoding::BITSHUFFLE},
+            {"o_orderstatus", encoding::DICT},
+            {"o_totalprice", encoding::BITSHUFFLE},
+            {"o_orderdate", encoding::BITSHUFFLE},
+            {"o_orderpriority", encoding::DICT},
+            {"o_clerk", encoding::DICT},
+            {"o_shippriority", encoding::RLE},
+            {"o_comment", encoding::PLAIN, compression::LZ4}
+        }};
+        return columns;
+    }
+
+    // the strings refer to the request frame
+    static row<StringView> fromOrder(const OrderView& order) {
+        return row<StringView>(order.orderkey, order.custkey, order.orderstatus,
+                decimal(order.totalprice), date::fromDays(order.orderdate), order.orderpriority,
+                order.clerk, order.shippriority, order.comment);
+    }
+};
+
+struct LineitemTable {
+    template<class String>
+    using row = std::tuple<int32_t, int32_t, int32_t, int32_t, decimal, decimal, decimal, decimal, char, char,
+            date, date, date, String, String, String>;
+    static const char* name() { return "lineitem"; }
+    static std::vector<std::string> primaryKey() { return {"l_orderkey", "l_linenumber"}; }
+    static const std::array<ColumnDef, 16>& columns() {
+        static const std::array<ColumnDef, 16> columns = {{
+            {"l_orderkey", encoding::BITSHUFFLE},
+            {"l_partkey", encoding::BITSHUFFLE},
+            {"l_suppkey", encoding::BITSHUFFLE},
+            {"l_linenumber", encoding::BITSHUFFLE},
+            {"l_quantity", encoding::BITSHUFFLE},
+            {"l_extendedprice", encoding::BITSHUFFLE},
+            {"l_discount", encoding::BITSHUFFLE},
+            {"l_tax", encoding::BITSHUFFLE},
+            {"l_returnflag", encoding::DICT},
+            {"l_linestatus", encoding::DICT},
+            {"l_shipdate", encoding::BITSHUFFLE},
+            {"l_commitdate", encoding::BITSHUFFLE},
+            {"l_receiptdate", encoding::BITSHUFFLE},
+            {"l_shipinstruct", encoding::DICT},
+            {"l_shipmode", encoding::DICT},
+            {"l_comment", encoding::PLAIN, compression::LZ4}
+        }};
+        return columns;
+    }
+
+    // the strings refer to the request frame
+    static row<StringView> fromLineitem(const LineitemView& line) {
+        return row<StringView>(line.orderkey, line.partkey, line.suppkey, line.linenumber,
+                decimal(line.quantity), decimal(line.extendedprice), decimal(line.discount), decimal(line.tax),
+                line.returnflag, line.linestatus,
+                date::fromDays(line.shipdate), date::fromDays(line.commitdate), date::fromDays(line.receiptdate),
+                line.shipinstruct, line.shipmode, line.comment);
+    }
+};
+
+struct NationTable {
+    template<class String>
+    using row = std::tuple<int32_t, String, int32_t, String>;
+    static const char* name() { return "nation"; }
+    static std::vector<std::string> primaryKey() { return {"n_nationkey"}; }
+    static const std::array<ColumnDef, 4>& columns() {
+        static const std::array<ColumnDef, 4> columns = {{
+            {"n_nationkey"},
+            {"n_name"},
+            {"n_regionkey"},
+            {"n_comment"}
+        }};
+        return columns;
+    }
+};
+
+struct RegionTable {
+    template<class String>
+    using row = std::tuple<int32_t, String, String>;
+    static const char* name() { return "region"; }
+    static std::vector<std::string> primaryKey() { return {"r_regionkey"}; }
+    static const std::array<ColumnDef, 3>& columns() {
+        static const std::array<ColumnDef, 3> columns = {{
+            {"r_regionkey"},
+            {"r_name"},
+            {"r_comment"}
+        }};
+        return columns;
+    }
+};
+
+// physical type of a column by its C++ type, strings are TEXT
+template<class T>
+struct column_traits {
+    static type physicalType(const SchemaOptions&) { return type::TEXT; }
+    static encoding physicalEncoding(encoding enc, const SchemaOptions&) { return enc; }
+};
+
+template<>
+struct column_traits<int32_t> {
+    static type physicalType(const SchemaOptions&) { return type::INT; }
+    static encoding physicalEncoding(encoding enc, const SchemaOptions&) { return enc; }
+};
+
+template<>
+struct column_traits<date> {
+    static type physicalType(const SchemaOptions& options) { return dateType(options); }
+    static encoding physicalEncoding(encoding enc, const SchemaOptions&) { return enc; }
+};
+
+template<>
+struct column_traits<decimal> {
+    static type physicalType(const SchemaOptions& options) { return decimalType(options); }
+    static encoding physicalEncoding(encoding enc, const SchemaOptions&) { return enc; }
+};
+
+template<>
+struct column_traits<char> {
+    static type physicalType(const SchemaOptions& options) { return flagType(options); }
+    // Kudu only dictionary encodes strings
+    static encoding physicalEncoding(encoding enc, const SchemaOptions& options) {
+        return options.compactTypes && enc == encoding::DICT ? encoding::RLE : enc;
+    }
+};
+
+struct ColumnSpec {
+    const char* name;
+    type t;
+    encoding enc;
+    compression comp;
+};
+
+template<class Row, size_t I = 0, size_t N = std::tuple_size<Row>::value>
+struct ColumnSpecs {
+    template<class Columns>
+    static void append(std::vector<ColumnSpec>& specs, const Columns& columns, const SchemaOptions& options) {
+        using traits = column_traits<typename std::tuple_element<I, Row>::type>;
+        auto& column = columns[I];
+        specs.emplace_back(ColumnSpec{column.name, traits::physicalType(options),
+                traits::physicalEncoding(column.enc, options), column.comp});
+        ColumnSpecs<Row, I + 1, N>::append(specs, columns, options);
+    }
+};
+
+template<class Row, size_t N>
+struct ColumnSpecs<Row, N, N> {
+    template<class Columns>
+    static void append(std::vector<ColumnSpec>&, const Columns&, const SchemaOptions&) {}
+};
+
+template<class Table>
+std::vector<std::string> columnNames() {
+    std::vector<std::string> names;
+    for (auto& column : Table::columns()) {
+        names.emplace_back(column.name);
+    }
+    return names;
+}
+
+// adds the columns of a table and sets its primary key, the key columns come
+// first as Kudu requires the primary key to be a prefix of the columns
+template<class Table, class TC>
+void addColumns(TC& tc, const SchemaOptions& options) {
+    using Row = typename Table::template row<std::string>;
+    static_assert(std::tuple_size<Row>::value == std::tuple_size<typename std::decay<decltype(Table::columns())>::type>::value,
+            "row type and columns of a table do not match");
+    std::vector<ColumnSpec> specs;
+    ColumnSpecs<Row>::append(specs, Table::columns(), options);
+    auto key = Table::primaryKey();
+    auto isKey = [&key](const ColumnSpec& spec) {
+        return std::find(key.begin(), key.end(), spec.name) != key.end();
+    };
+    for (auto& spec : specs) {
+        if (isKey(spec))
+            tc(spec.name, spec.t, spec.enc, spec.comp);
+    }
+    for (auto& spec : specs) {
+        if (!isKey(spec))
+            tc(spec.name, spec.t, spec.enc, spec.comp);
+    }
+    tc.setPrimaryKey(key);
+}
+
+template<class String, class Set>
+void writeColumn(Set& set, size_t column, int32_t value, const SchemaOptions&) {
+    set(column, value);
+}
+
+template<class String, class Set>
+void writeColumn(Set& set, size_t column, date value, const SchemaOptions& options) {
+    setDate(set, column, value, options);
+}
+
+template<class String, class Set>
+void writeColumn(Set& set, size_t column, decimal value, const SchemaOptions& options) {
+    setDecimal(set, column, value, options);
+}
+
+template<class String, class Set>
+void writeColumn(Set& set, size_t column, char value, const SchemaOptions& options) {
+    setFlag<String>(set, column, value, options);
+}
+
+template<class String, class Set, class Str>
+void writeColumn(Set& set, size_t column, const Str& value, const SchemaOptions&) {
+    set(column, value);
+}
+
+template<class String, class Row, size_t I = 0, size_t N = std::tuple_size<Row>::value>
+struct RowWriter {
+    template<class Set>
+    static void write(Set& set, const Row& row, const SchemaOptions& options) {
+        writeColumn<String>(set, I, std::get<I>(row), options);
+        RowWriter<String, Row, I + 1, N>::write(set, row, options);
+    }
+};
+
+template<class String, class Row, size_t N>
+struct RowWriter<String, Row, N, N> {
+    template<class Set>
+    static void write(Set&, const Row&, const SchemaOptions&) {}
+};
+
+// calls set(column, value) with the position of every column in the table
+// descriptor and its physical value, flags that are stored as TEXT are passed
+// as String
+template<class String, class Set, class Row>
+void writeRow(Set& set, const Row& row, const SchemaOptions& options) {
+    RowWriter<String, Row>::write(set, row, options);
+}
+
 template<class T>
 struct TableCreator;
 
 template<class T>
-void createPart(T& tx, double scalingFactor, int partitions) {
-    TableCreator<T> tc(tx);
-    tc("p_partkey", type::INT);
-    tc("p_name", type::TEXT);
-    tc("p_mfgr", type::TEXT);
-    tc("p_brand", type::TEXT);
-    tc("p_type", type::TEXT);
-    tc("p_size", type::INT);
-    tc("p_container", type::TEXT);
-    tc("p_retailprice", type::DOUBLE);
-    tc("p_comment", type::TEXT);
-    tc.setPrimaryKey({"p_partkey"});
-    tc.create("part", scalingFactor, partitions);
+void createPart(T& tx, double scalingFactor, const SchemaOptions& options) {
+    TableCreator<T> tc(tx, options);
+    addColumns<PartTable>(tc, options);
+    tc.create(PartTable::name(), scalingFactor);
 }
 
 template<class T>
-void createSupplier(T& tx, double scalingFactor, int partitions) {
-    TableCreator<T> tc(tx);
-    tc("s_suppkey", type::INT);
-    tc("s_name", type::TEXT);
-    tc("s_address", type::TEXT);
-    tc("s_nationkey", type::INT);
-    tc("s_phone", type::TEXT);
-    tc("s_acctbal", type::DOUBLE);
-    tc("s_comment", type::TEXT);
-    tc.setPrimaryKey({"s_suppkey"});
-    tc.create("supplier", scalingFactor, partitions);
+void createSupplier(T& tx, double scalingFactor, const SchemaOptions& options) {
+    TableCreator<T> tc(tx, options);
+    addColumns<SupplierTable>(tc, options);
+    tc.create(SupplierTable::name(), scalingFactor);
 }
 
 template<class T>
-void createPartsupp(T& tx, double scalingFactor, int partitions) {
-    TableCreator<T> tc(tx);
-    tc("ps_partkey", type::INT);
-    tc("ps_suppkey", type::INT);
-    tc("ps_availqty", type::INT);
-    tc("ps_supplycost", type::DOUBLE);
-    tc("ps_comment", type::TEXT);
-    tc.setPrimaryKey({"ps_partkey", "ps_suppkey"});
-    tc.create("partsupp", scalingFactor, partitions);
+void createPartsupp(T& tx, double scalingFactor, const SchemaOptions& options) {
+    TableCreator<T> tc(tx, options);
+    addColumns<PartsuppTable>(tc, options);
+    tc.create(PartsuppTable::name(), scalingFactor);
 }
 
 template<class T>
-void createCustomer(T& tx, double scalingFactor, int partitions) {
-    TableCreator<T> tc(tx);
-    tc("c_custkey", type::INT);
-    tc("c_name", type::TEXT);
-    tc("c_address", type::TEXT);
-    tc("c_nationkey", type::INT);
-    tc("c_phone", type::TEXT);
-    tc("c_acctbal", type::DOUBLE);
-    tc("c_mktsegment", type::TEXT);
-    tc("c_comment", type::TEXT);
-    tc.setPrimaryKey({"c_custkey"});
-    tc.create("customer", scalingFactor, partitions);
+void createCustomer(T& tx, double scalingFactor, const SchemaOptions& options) {
+    TableCreator<T> tc(tx, options);
+    addColumns<CustomerTable>(tc, options);
+    tc.create(CustomerTable::name(), scalingFactor);
 }
 
 template<class T>
-void createOrder(T& tx, double scalingFactor, int partitions) {
-    TableCreator<T> tc(tx);
-    tc("o_orderkey", type::INT);
-    tc("o_custkey", type::INT);
-    tc("o_orderstatus", type::TEXT);
-    tc("o_totalprice", type::DOUBLE);
-    tc("o_orderdate", type::BIGINT);
-    tc("o_orderpriority", type::TEXT);
-    tc("o_clerk", type::TEXT);
-    tc("o_shippriority", type::INT);
-    tc("o_comment", type::TEXT);
-    tc.setPrimaryKey({"o_orderkey"});
-    tc.create("orders", scalingFactor, partitions);
+void createOrder(T& tx, double scalingFactor, const SchemaOptions& options) {
+    TableCreator<T> tc(tx, options);
+    addColumns<OrdersTable>(tc, options);
+    if (options.naturalKeys) {
+        tc.useNaturalKey();
+    } else {
+        // RF2 finds the orders through this index
+        tc.addIndex({"o_orderkey_idx", true, {"o_orderkey"}});
+    }
+    tc.create(OrdersTable::name(), scalingFactor);
 }
 
 template<class T>
-void createLineitem(T& tx, double scalingFactor, int partitions) {
-    TableCreator<T> tc(tx);
-    tc("l_orderkey", type::INT);
-    tc("l_linenumber", type::INT);  // linenumber must be listed first because it is part of the primary key
-    tc("l_partkey", type::INT);
-    tc("l_suppkey", type::INT);
-    tc("l_quantity", type::DOUBLE);
-    tc("l_extendedprice", type::DOUBLE);
-    tc("l_discount", type::DOUBLE);
-    tc("l_tax", type::DOUBLE);
-    tc("l_returnflag", type::TEXT);
-    tc("l_linestatus", type::TEXT);
-    tc("l_shipdate", type::BIGINT);
-    tc("l_commitdate", type::BIGINT);
-    tc("l_receiptdate", type::BIGINT);
-    tc("l_shipinstruct", type::TEXT);
-    tc("l_shipmode", type::TEXT);
-    tc("l_comment", type::TEXT);
-    tc.setPrimaryKey({"l_orderkey", "l_linenumber"});
-    tc.create("lineitem", scalingFactor, partitions);
+void createLineitem(T& tx, double scalingFactor, const SchemaOptions& options) {
+    TableCreator<T> tc(tx, options);
+    addColumns<LineitemTable>(tc, options);
+    if (options.naturalKeys) {
+        tc.useNaturalKey();
+    } else {
+        // RF2 finds the lines of an order through this index
+        tc.addIndex({"l_orderkey_idx", false, {"l_orderkey"}});
+        tc.addIndex({"l_orderkey_linenumber_idx", true, {"l_orderkey", "l_linenumber"}, true});
+    }
+    tc.addIndex({"l_shipdate_idx", false, {"l_shipdate"}, true});
+    tc.create(LineitemTable::name(), scalingFactor);
 }
 
 template<class T>
-void createNation(T& tx) {
-    TableCreator<T> tc(tx);
-    tc("n_nationkey", type::INT);
-    tc("n_name", type::TEXT);
-    tc("n_regionkey", type::INT);
-    tc("n_comment", type::TEXT);
-    tc.setPrimaryKey({"n_nationkey"});
-    tc.create("nation", 0, 0);
+void createNation(T& tx, const SchemaOptions& options) {
+    TableCreator<T> tc(tx, options);
+    addColumns<NationTable>(tc, options);
+    tc.create(NationTable::name(), 0);
 }
 
 template<class T>
-void createRegion(T& tx) {
-    TableCreator<T> tc(tx);
-    tc("r_regionkey", type::INT);
-    tc("r_name", type::TEXT);
-    tc("r_comment", type::TEXT);
-    tc.setPrimaryKey({"r_regionkey"});
-    tc.create("region", 0, 0);
+void createRegion(T& tx, const SchemaOptions& options) {
+    TableCreator<T> tc(tx, options);
+    addColumns<RegionTable>(tc, options);
+    tc.create(RegionTable::name(), 0);
 }
 
 template<class T>
-void createTables(T& tx, double scalingFactor, int partitions) {
-    createPart(tx, scalingFactor, partitions);
-    createSupplier(tx, scalingFactor, partitions);
-    createPartsupp(tx, scalingFactor, partitions);
-    createCustomer(tx, scalingFactor, partitions);
-    createOrder(tx, scalingFactor, partitions);
-    createLineitem(tx, scalingFactor, partitions);
-    createNation(tx);
-    createRegion(tx);
+void createTables(T& tx, double scalingFactor, const SchemaOptions& options) {
+    createPart(tx, scalingFactor, options);
+    createSupplier(tx, scalingFactor, options);
+    createPartsupp(tx, scalingFactor, options);
+    createCustomer(tx, scalingFactor, options);
+    createOrder(tx, scalingFactor, options);
+    createLineitem(tx, scalingFactor, options);
+    createNation(tx, options);
+    createRegion(tx, options);
 }
 
 template<class T>
@@ -214,162 +602,20 @@ struct Populate {
     using string = typename string_type<T>::type;
     using P = Populator<T>;
     T& tx;
+    const SchemaOptions& options;
 
-    Populate(T& tx)
+    Populate(T& tx, const SchemaOptions& options)
         : tx(tx)
+        , options(options)
     {}
 
-    void populatePart(std::istream& in) {
-        using t = std::tuple<int32_t, string, string, string, string, int32_t, string, double, string>;
-        P p(tx, "part");
-        uint64_t count = 0;
-        getFields<t>(in, [&count, &p] (const t& fields) {
-            p("p_partkey",     std::get<0>(fields));
-            p("p_name",        std::get<1>(fields));
-            p("p_mfgr",        std::get<2>(fields));
-            p("p_brand",       std::get<3>(fields));
-            p("p_type",        std::get<4>(fields));
-            p("p_size",        std::get<5>(fields));
-            p("p_container",   std::get<6>(fields));
-            p("p_retailprice", std::get<7>(fields));
-            p("p_comment",     std::get<8>(fields));
-            p.apply();
-            if (++count % 1000u == 0u)
-                p.flush();
-        });
-        p.flush();
-    }
-
-    void populateSupplier(std::istream& in) {
-        using t = std::tuple<int32_t, string, string, int32_t, string, double, string>;
-        P p(tx, "supplier");
-        uint64_t count = 0;
-        getFields<t>(in, [&count, &p] (const t& fields) {
-            p("s_suppkey",   std::get<0>(fields));
-            p("s_name",      std::get<1>(fields));
-            p("s_address",   std::get<2>(fields));
-            p("s_nationkey", std::get<3>(fields));
-            p("s_phone",     std::get<4>(fields));
-            p("s_acctbal",   std::get<5>(fields));
-            p("s_comment",   std::get<6>(fields));
-            p.apply();
-            if (++count % 1000 == 0)
-                p.flush();
-        });
-        p.flush();
-    }
-
-    void populatePartsupp(std::istream& in) {
-        using t = std::tuple<int32_t, int32_t, int32_t, double, string>;
-        P p(tx, "partsupp");
+    template<class Table>
+    void populate(std::istream& in) {
+        using t = typename Table::template row<string>;
+        P p(tx, Table::name(), columnNames<Table>(), options);
         uint64_t count = 0;
         getFields<t>(in, [&count, &p] (const t& fields) {
-            p("ps_partkey",   std::get<0>(fields));
-            p("ps_suppkey",   std::get<1>(fields));
-            p("ps_availqty",  std::get<2>(fields));
-            p("ps_supplycost",std::get<3>(fields));
-            p("ps_comment",   std::get<4>(fields));
-            p.apply();
-            if (++count % 1000 == 0)
-                p.flush();
-        });
-        p.flush();
-    }
-
-    void populateCustomer(std::istream& in) {
-        using t = std::tuple<int32_t, string, string, int32_t, string, double, string, string>;
-        P p(tx, "customer");
-        uint64_t count = 0;
-        getFields<t>(in, [&count, &p] (const t& fields) {
-            p("c_custkey",    std::get<0>(fields));
-            p("c_name",       std::get<1>(fields));
-            p("c_address",    std::get<2>(fields));
-            p("c_nationkey",  std::get<3>(fields));
-            p("c_phone",      std::get<4>(fields));
-            p("c_acctbal",    std::get<5>(fields));
-            p("c_mktsegment", std::get<6>(fields));
-            p("c_comment",    std::get<7>(fields));
-            p.apply();
-            if (++count % 1000 == 0)
-                p.flush();
-        });
-        p.flush();
-    }
-
-    void populateOrder(std::istream& in) {
-        using t = std::tuple<int32_t, int32_t, string, double, date, string, string, int32_t, string>;
-        P p(tx, "orders");
-        uint64_t count = 0;
-        getFields<t>(in, [&count, &p] (const t& fields) {
-            p("o_orderkey",     std::get<0>(fields));
-            p("o_custkey",      std::get<1>(fields));
-            p("o_orderstatus",  std::get<2>(fields));
-            p("o_totalprice",   std::get<3>(fields));
-            p("o_orderdate",    std::get<4>(fields));
-            p("o_orderpriority",std::get<5>(fields));
-            p("o_clerk",        std::get<6>(fields));
-            p("o_shippriority", std::get<7>(fields));
-            p("o_comment",      std::get<8>(fields));
-            p.apply();
-            if (++count % 1000 == 0)
-                p.flush();
-        });
-        p.flush();
-    }
-
-    void populateLineitem(std::istream& in) {
-        using t = std::tuple<int32_t, int32_t, int32_t, int32_t, double, double, double, double, string, string, date, date, date, string, string, string>;
-        P p(tx, "lineitem");
-        uint64_t count = 0;
-        getFields<t>(in, [&count, &p] (const t& fields) {
-            p("l_orderkey",      std::get<0>(fields));
-            p("l_partkey",       std::get<1>(fields));
-            p("l_suppkey",       std::get<2>(fields));
-            p("l_linenumber",    std::get<3>(fields));
-            p("l_quantity",      std::get<4>(fields));
-            p("l_extendedprice", std::get<5>(fields));
-            p("l_discount",      std::get<6>(fields));
-            p("l_tax",           std::get<7>(fields));
-            p("l_returnflag",    std::get<8>(fields));
-            p("l_linestatus",    std::get<9>(fields));
-            p("l_shipdate",      std::get<10>(fields));
-            p("l_commitdate",    std::get<11>(fields));
-            p("l_receiptdate",   std::get<12>(fields));
-            p("l_shipinstruct",  std::get<13>(fields));
-            p("l_shipmode",      std::get<14>(fields));
-            p("l_comment",       std::get<15>(fields));
-            p.apply();
-            if (++count % 1000 == 0)
-                p.flush();
-        });
-        p.flush();
-    }
-
-    void populateNation(std::istream& in) {
-        using t = std::tuple<int32_t, string, int32_t, string>;
-        P p(tx, "nation");
-        uint64_t count = 0;
-        getFields<t>(in, [&count, &p] (const t& fields) {
-            p("n_nationkey", std::get<0>(fields));
-            p("n_name",      std::get<1>(fields));
-            p("n_regionkey", std::get<2>(fields));
-            p("n_comment",   std::get<3>(fields));
-            p.apply();
-            if (++count % 1000 == 0)
-                p.flush();
-        });
-        p.flush();
-    }
-
-    void populateRegion(std::istream& in) {
-        using t = std::tuple<int32_t, string, string>;
-        P p(tx, "region");
-        uint64_t count = 0;
-        getFields<t>(in, [&count, &p] (const t& fields) {
-            p("r_regionkey", std::get<0>(fields));
-            p("r_name",      std::get<1>(fields));
-            p("r_comment",   std::get<2>(fields));
-            p.apply();
+            p.insert(fields);
             if (++count % 1000 == 0)
                 p.flush();
         });
@@ -380,21 +626,21 @@ struct Populate {
 template <class T>
 void populateTable(std::string &tableName, const std::shared_ptr<std::stringstream> data, T &populate) {
     if (tableName == "part") {
-        populate.populatePart(*data);
+        populate.template populate<PartTable>(*data);
     } else if (tableName == "partsupp") {
-        populate.populatePartsupp(*data);
+        populate.template populate<PartsuppTable>(*data);
     } else if (tableName == "supplier") {
-        populate.populateSupplier(*data);
+        populate.template populate<SupplierTable>(*data);
     } else if (tableName == "customer") {
-        populate.populateCustomer(*data);
+        populate.template populate<CustomerTable>(*data);
     } else if (tableName == "orders") {
-        populate.populateOrder(*data);
+        populate.template populate<OrdersTable>(*data);
     } else if (tableName == "lineitem") {
-        populate.populateLineitem(*data);
+        populate.template populate<LineitemTable>(*data);
     } else if (tableName == "nation") {
-        populate.populateNation(*data);
+        populate.template populate<NationTable>(*data);
     } else if (tableName == "region") {
-        populate.populateRegion(*data);
+        populate.template populate<RegionTable>(*data);
     } else {
         std::cerr << "Table " << tableName << " does not exist" << std::endl;
         std::terminate();
@@ -403,28 +649,50 @@ void populateTable(std::string &tableName, const std::shared_ptr<std::stringstre
 
 template<class ClientType, class FiberType>
 struct DBGenBase {
-    void createSchema(ClientType& connection, double scalingFactor, int partitions);
+    struct LoadContext;
+    void createSchema(ClientType& connection, double scalingFactor, const SchemaOptions& options);
+    LoadContext startLoad(ClientType& client, const std::string& baseDir, const std::string& tableName,
+            const SchemaOptions& options);
     void threaded_populate(ClientType &client, std::queue<FiberType> &fibers,
-            std::string &tableName, const std::shared_ptr<std::stringstream> data);
+            std::string &tableName, const std::shared_ptr<std::stringstream> data, LoadContext& context);
+    void finishLoad(ClientType& client, LoadContext& context);
     void join(FiberType &fiber);
 };
 
 template<>
 struct DBGenBase<TellClient, TellFiber> {
-    void createSchema(TellClient& connection, double scalingFactor, int partitions);
+    struct LoadContext {
+        const SchemaOptions& options;
+    };
+
+    void createSchema(TellClient& connection, double scalingFactor, const SchemaOptions& options);
+    LoadContext startLoad(TellClient&, const std::string&, const std::string&, const SchemaOptions& options) {
+        return LoadContext{options};
+    }
     void threaded_populate(TellClient &client, std::queue<TellFiber> &fibers,
-            std::string &tableName, const std::shared_ptr<std::stringstream> data);
+            std::string &tableName, const std::shared_ptr<std::stringstream> data, LoadContext& context);
+    void finishLoad(TellClient&, LoadContext&) {}
     void join(TellFiber &fiber);
 };
 
 extern template struct DBGenBase<TellClient, TellFiber>;
 
 #ifdef USE_KUDU
+class TabletRouter;
+
 template<>
 struct DBGenBase<KuduClient, KuduFiber> {
-    void createSchema(KuduClient& connection, double scalingFactor, int partitions);
+    struct LoadContext {
+        const SchemaOptions& options;
+        std::shared_ptr<TabletRouter> router; // only set if routed load is enabled
+    };
+
+    void createSchema(KuduClient& connection, double scalingFactor, const SchemaOptions& options);
+    LoadContext startLoad(KuduClient& client, const std::string& baseDir, const std::string& tableName,
+            const SchemaOptions& options);
     void threaded_populate(KuduClient &client, std::queue<KuduFiber> &fibers,
-            std::string &tableName, const std::shared_ptr<std::stringstream> data);
+            std::string &tableName, const std::shared_ptr<std::stringstream> data, LoadContext& context);
+    void finishLoad(KuduClient& client, LoadContext& context);
     void join(KuduFiber &fiber);
 };
 
@@ -434,11 +702,11 @@ extern template struct DBGenBase<KuduClient, KuduFiber>;
 template<class ClientType, class FiberType>
 struct DBGenerator : public DBGenBase<ClientType, FiberType> {
 
-    void createTables (ClientType &client, double scalingFactor, int partitions) {
-        this->createSchema(client, scalingFactor, partitions);
+    void createTables (ClientType &client, double scalingFactor, const SchemaOptions& options) {
+        this->createSchema(client, scalingFactor, options);
     }
 
-    void populate(ClientType &client, std::string &baseDir, uint32_t partIndex) {
+    void populate(ClientType &client, std::string &baseDir, uint32_t partIndex, const SchemaOptions& options) {
         for (std::string tableName : {"part", "partsupp", "supplier", "customer", "orders", "lineitem", "nation", "region"}) {
             std::string fileName = baseDir + "/" + tableName + ".tbl";
             if (partIndex > 0)
@@ -451,6 +719,7 @@ struct DBGenerator : public DBGenBase<ClientType, FiberType> {
             std::fstream in(fileName.c_str(), std::ios_base::in);
             std::string line;
 
+            auto context = this->startLoad(client, baseDir, tableName, options);
             std::queue<FiberType> fibers;
             while (true) {
                 auto data = std::make_shared<std::stringstream>();
@@ -463,12 +732,13 @@ struct DBGenerator : public DBGenBase<ClientType, FiberType> {
                 if (count == 0) {
                     break;
                 }
-                this->threaded_populate(client, fibers, tableName, data);
+                this->threaded_populate(client, fibers, tableName, data, context);
             }
             while (!fibers.empty()) {
                 this->join(fibers.front());
                 fibers.pop();
             }
+            this->finishLoad(client, context);
 
             std::cout << std::endl << std::endl;
         }
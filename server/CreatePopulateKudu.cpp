@@ -22,19 +22,48 @@
  */
 #include "CreatePopulate.hpp"
 
+#include <algorithm>
+#include <mutex>
+
 #include "KuduUtil.hpp"
 
 namespace tpch {
 
 using namespace kudu::client;
 
+namespace {
+
+// number of items the range partitioning of a table is based on, 0 if the
+// table is not partitioned
+int numItemsOf(const std::string& name, double scalingFactor) {
+    if (name == "part") {
+        return 200000 * scalingFactor;
+    } else if (name == "partsupp") {
+        return 800000 * scalingFactor;
+    } else if (name == "supplier") {
+        return 10000 * scalingFactor;
+    } else if (name == "customer") {
+        return 150000 * scalingFactor;
+    } else if (name == "orders") {
+        return 1500000 * scalingFactor;
+    } else if (name == "lineitem") {
+        return 6000000 * scalingFactor;
+    }
+    return 0;
+}
+
+} // anonymous namespace
+
 template<>
 struct TableCreator<kudu::client::KuduSession> {
     KuduSession& session;
+    const SchemaOptions& options;
     std::unique_ptr<KuduTableCreator> tableCreator;
     KuduSchemaBuilder schemaBuilder;
-    TableCreator(KuduSession& session)
+    std::vector<std::string> primaryKey;
+    TableCreator(KuduSession& session, const SchemaOptions& options)
         : session(session)
+        , options(options)
         , tableCreator(session.client()->NewTableCreator())
     {
         tableCreator->num_replicas(1);
@@ -42,6 +71,11 @@ struct TableCreator<kudu::client::KuduSession> {
 
     template<class S>
     void operator() (const S& name, type t, bool notNull = true) {
+        (*this)(name, t, encoding::AUTO, compression::DEFAULT, notNull);
+    }
+
+    template<class S>
+    void operator() (const S& name, type t, encoding enc, compression comp = compression::DEFAULT, bool notNull = true) {
         auto col = schemaBuilder.AddColumn(name);
         switch (t) {
         case type::SMALLINT:
@@ -63,6 +97,43 @@ struct TableCreator<kudu::client::KuduSession> {
             col->Type(KuduColumnSchema::STRING);
             break;
         }
+        switch (enc) {
+        case encoding::AUTO:
+            col->Encoding(KuduColumnStorageAttributes::AUTO_ENCODING);
+            break;
+        case encoding::PLAIN:
+            col->Encoding(KuduColumnStorageAttributes::PLAIN_ENCODING);
+            break;
+        case encoding::PREFIX:
+            col->Encoding(KuduColumnStorageAttributes::PREFIX_ENCODING);
+            break;
+        case encoding::RLE:
+            col->Encoding(KuduColumnStorageAttributes::RLE);
+            break;
+        case encoding::DICT:
+            col->Encoding(KuduColumnStorageAttributes::DICT_ENCODING);
+            break;
+        case encoding::BITSHUFFLE:
+            col->Encoding(KuduColumnStorageAttributes::BIT_SHUFFLE);
+            break;
+        }
+        switch (comp) {
+        case compression::DEFAULT:
+            col->Compression(KuduColumnStorageAttributes::DEFAULT_COMPRESSION);
+            break;
+        case compression::NONE:
+            col->Compression(KuduColumnStorageAttributes::NO_COMPRESSION);
+            break;
+        case compression::SNAPPY:
+            col->Compression(KuduColumnStorageAttributes::SNAPPY);
+            break;
+        case compression::LZ4:
+            col->Compression(KuduColumnStorageAttributes::LZ4);
+            break;
+        case compression::ZLIB:
+            col->Compression(KuduColumnStorageAttributes::ZLIB);
+            break;
+        }
         if (notNull) {
             col->NotNull();
         } else {
@@ -72,30 +143,31 @@ struct TableCreator<kudu::client::KuduSession> {
 
     void setPrimaryKey(const std::vector<std::string>& key) {
         schemaBuilder.SetPrimaryKey(key);
+        primaryKey = key;
     }
 
-    void create(const std::string& name, double scalingFactor, int partitions) {
-        int numItems = 0;
-        if (name == "part") {
-            numItems = 200000 * scalingFactor;
-        } else if (name == "partsupp") {
-            numItems = 800000 * scalingFactor;
-        } else if (name == "supplier") {
-            numItems = 10000 * scalingFactor;
-        } else if (name == "customer") {
-            numItems = 150000 * scalingFactor;
-        } else if (name == "orders") {
-            numItems = 1500000 * scalingFactor;
-        } else if (name == "lineitem") {
-            numItems = 6000000 * scalingFactor;
-        }
+    // rows are always keyed by their primary key
+    void useNaturalKey() {}
+
+    // Kudu has no secondary indexes, lookups go through the primary key
+    void addIndex(const IndexSpec&) {}
+
+    void create(const std::string& name, double scalingFactor) {
+        int numItems = numItemsOf(name, scalingFactor);
 
         KuduSchema schema;
         assertOk(schemaBuilder.Build(&schema));
         tableCreator->schema(&schema);
         tableCreator->table_name(name);
         if (numItems > 0) {
-            auto splits = createRangePartitioning(numItems, partitions, schema);
+            // hash buckets spread the newest keys (RF1) and the deleted key
+            // window (RF2) over several tablets, the range splits are added
+            // on top of them
+            int hashBuckets = options.hashBucketsOf(name);
+            if (hashBuckets > 1) {
+                tableCreator->add_hash_partitions({primaryKey[0]}, hashBuckets);
+            }
+            auto splits = createRangePartitioning(numItems, options.partitions, schema);
             tableCreator->split_rows(splits);
         }
         assertOk(tableCreator->Create());
@@ -106,68 +178,49 @@ struct TableCreator<kudu::client::KuduSession> {
 template<>
 struct Populator<KuduSession> {
     KuduSession& session;
+    const SchemaOptions& options;
     std::tr1::shared_ptr<KuduTable> table;
     std::unique_ptr<KuduInsert> ins;
     kudu::KuduPartialRow* row;
-    std::vector<std::string> names;
-    std::vector<std::string> vals;
-    Populator(KuduSession& session, const std::string& tableName)
+    // Kudu column index of every column of the row
+    std::vector<int> columnIds;
+    Populator(KuduSession& session, const std::string& tableName, const std::vector<std::string>& columns,
+            const SchemaOptions& options)
         : session(session)
+        , options(options)
     {
         assertOk(session.client()->OpenTable(tableName, &table));
+        columnIds = columnIndexes(*table, columns);
         ins.reset(table->NewInsert());
         row = ins->mutable_row();
     }
 
-    template<class Str>
-    void operator() (Str&& name, int16_t val) {
-        names.emplace_back(std::forward<Str>(name));
-        assertOk(row->SetInt16(names.back(), val));
-    }
-
-    template<class Str>
-    void operator() (Str&& name, int32_t val) {
-        names.emplace_back(std::forward<Str>(name));
-        assertOk(row->SetInt32(names.back(), val));
+    void operator() (size_t column, int16_t val) {
+        assertOk(row->SetInt16(columnIds[column], val));
     }
 
-    template<class Str>
-    void operator() (Str&& name, int64_t val) {
-        names.emplace_back(std::forward<Str>(name));
-        assertOk(row->SetInt64(names.back(), val));
+    void operator() (size_t column, int32_t val) {
+        assertOk(row->SetInt32(columnIds[column], val));
     }
 
-    template<class Str>
-    void operator() (Str&& name, date d) {
-        names.emplace_back(std::forward<Str>(name));
-        assertOk(row->SetInt64(names.back(), d.value));
+    void operator() (size_t column, int64_t val) {
+        assertOk(row->SetInt64(columnIds[column], val));
     }
 
-    template<class Str>
-    void operator() (Str&& name, float val) {
-        names.emplace_back(std::forward<Str>(name));
-        assertOk(row->SetFloat(names.back(), val));
+    void operator() (size_t column, double val) {
+        assertOk(row->SetDouble(columnIds[column], val));
     }
 
-    template<class Str>
-    void operator() (Str&& name, double val) {
-        names.emplace_back(std::forward<Str>(name));
-        assertOk(row->SetDouble(names.back(), val));
+    void operator() (size_t column, const std::string& val) {
+        assertOk(row->SetStringCopy(columnIds[column], val));
     }
 
-    template<class Str1, class Str2>
-    void operator() (Str1&& name, Str2&& val) {
-        names.emplace_back(std::forward<Str1>(name));
-        vals.emplace_back(std::forward<Str2>(val));
-        assertOk(row->SetStringCopy(names.back(), vals.back()));
-    }
-
-    void apply() {
+    template<class Row>
+    void insert(const Row& values) {
+        writeRow<std::string>(*this, values, options);
         assertOk(session.Apply(ins.release()));
         ins.reset(table->NewInsert());
         row = ins->mutable_row();
-        names.clear();
-        vals.clear();
     }
 
     void flush() {
@@ -183,26 +236,136 @@ struct string_type<KuduSession> {
     using type = std::string;
 };
 
-void DBGenBase<KuduClient, KuduFiber>::createSchema(KuduClient& client, double scalingFactor, int partitions) {
+/**
+ * Collects the inserts of all populate threads of one table in one buffer per
+ * range partition (using the same split keys as createRangePartitioning). A
+ * buffer is sent as soon as it is full, so every flush carries a large batch
+ * for a single tablet instead of a few rows for almost every tablet. Only
+ * for tables without hash buckets, a range is one tablet only then.
+ */
+class TabletRouter {
+    static constexpr size_t batchSize = 5000;
+    std::vector<int32_t> mSplits;
+    std::vector<std::mutex> mMutexes;
+    std::vector<std::vector<std::unique_ptr<KuduInsert>>> mBuffers;
+public:
+    TabletRouter(std::vector<int32_t> splits)
+        : mSplits(std::move(splits))
+        , mMutexes(mSplits.size() + 1)
+        , mBuffers(mSplits.size() + 1)
+    {}
+
+    // routes ins by the value of the first key column, a full buffer gets
+    // sent through the session of the caller
+    void add(std::unique_ptr<KuduInsert> ins, KuduSession& session) {
+        int32_t key;
+        assertOk(ins->mutable_row()->GetInt32(0, &key));
+        auto partition = std::upper_bound(mSplits.begin(), mSplits.end(), key) - mSplits.begin();
+        std::vector<std::unique_ptr<KuduInsert>> batch;
+        {
+            std::lock_guard<std::mutex> _(mMutexes[partition]);
+            mBuffers[partition].emplace_back(std::move(ins));
+            if (mBuffers[partition].size() < batchSize)
+                return;
+            batch.swap(mBuffers[partition]);
+        }
+        send(batch, session);
+    }
+
+    // sends all buffered inserts
+    void flush(KuduSession& session) {
+        for (size_t partition = 0; partition < mBuffers.size(); ++partition) {
+            std::vector<std::unique_ptr<KuduInsert>> batch;
+            {
+                std::lock_guard<std::mutex> _(mMutexes[partition]);
+                batch.swap(mBuffers[partition]);
+            }
+            send(batch, session);
+        }
+    }
+
+private:
+    static void send(std::vector<std::unique_ptr<KuduInsert>>& batch, KuduSession& session) {
+        if (batch.empty())
+            return;
+        for (auto& ins : batch) {
+            assertOk(session.Apply(ins.release()));
+        }
+        assertOk(session.Flush());
+    }
+};
+
+struct RoutedSession {
+    KuduSession& session;
+    TabletRouter& router;
+};
+
+template<>
+struct Populator<RoutedSession> : Populator<KuduSession> {
+    TabletRouter& router;
+
+    Populator(RoutedSession& routed, const std::string& tableName, const std::vector<std::string>& columns,
+            const SchemaOptions& options)
+        : Populator<KuduSession>(routed.session, tableName, columns, options)
+        , router(routed.router)
+    {}
+
+    template<class Row>
+    void insert(const Row& values) {
+        writeRow<std::string>(*this, values, options);
+        router.add(std::move(ins), session);
+        ins.reset(table->NewInsert());
+        row = ins->mutable_row();
+    }
+
+    // the router decides when to send
+    void flush() {
+    }
+};
+
+template<>
+struct string_type<RoutedSession> {
+    using type = std::string;
+};
+
+void DBGenBase<KuduClient, KuduFiber>::createSchema(KuduClient& client, double scalingFactor, const SchemaOptions& options) {
     auto session = client->NewSession();
     assertOk(session->SetFlushMode(kudu::client::KuduSession::MANUAL_FLUSH));
     session->SetTimeoutMillis(60000);
-    createTables(*session, scalingFactor, partitions);
+    createTables(*session, scalingFactor, options);
     assertOk(session->Close());
 }
 
+DBGenBase<KuduClient, KuduFiber>::LoadContext DBGenBase<KuduClient, KuduFiber>::startLoad(KuduClient&,
+        const std::string& baseDir, const std::string& tableName, const SchemaOptions& options) {
+    LoadContext context{options, nullptr};
+    int numItems = numItemsOf(tableName, getScalingFactor(baseDir));
+    if (options.routedLoad && numItems > 0) {
+        context.router = std::make_shared<TabletRouter>(rangeSplits(numItems, options.partitions));
+    }
+    return context;
+}
+
 void DBGenBase<KuduClient, KuduFiber>::threaded_populate(KuduClient &client, std::queue<KuduFiber> &threads,
-        std::string &tableName, const std::shared_ptr<std::stringstream> data) {
+        std::string &tableName, const std::shared_ptr<std::stringstream> data, LoadContext& context) {
     if (threads.size() >= 8) {
         threads.front().join();
         threads.pop();
     }
-    threads.emplace([&client, &tableName, data] () {
+    auto router = context.router;
+    auto options = &context.options;
+    threads.emplace([&client, &tableName, data, router, options] () {
         auto session = client->NewSession();
         assertOk(session->SetFlushMode(kudu::client::KuduSession::MANUAL_FLUSH));
         session->SetTimeoutMillis(60000);
-        Populate<kudu::client::KuduSession> populate(*session);
-        populateTable(tableName, data, populate);
+        if (router) {
+            RoutedSession routed{*session, *router};
+            Populate<RoutedSession> populate(routed, *options);
+            populateTable(tableName, data, populate);
+        } else {
+            Populate<kudu::client::KuduSession> populate(*session, *options);
+            populateTable(tableName, data, populate);
+        }
         assertOk(session->Flush());
         assertOk(session->Close());
         std::cout << '.';
@@ -210,6 +373,16 @@ void DBGenBase<KuduClient, KuduFiber>::threaded_populate(KuduClient &client, std
     });
 }
 
+void DBGenBase<KuduClient, KuduFiber>::finishLoad(KuduClient& client, LoadContext& context) {
+    if (!context.router)
+        return;
+    auto session = client->NewSession();
+    assertOk(session->SetFlushMode(kudu::client::KuduSession::MANUAL_FLUSH));
+    session->SetTimeoutMillis(60000);
+    context.router->flush(*session);
+    assertOk(session->Close());
+}
+
 void DBGenBase<KuduClient, KuduFiber>::join(KuduFiber &thread) {
     thread.join();
 }
@@ -0,0 +1,137 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include "GroupCommit.hpp"
+#include "AdmissionControl.hpp"
+
+#include <crossbow/logger.hpp>
+
+#include <algorithm>
+
+namespace tpch {
+
+GroupCommitter::GroupCommitter(TellClient client, boost::asio::io_service& service,
+        TableCache<Transactions::CachedTable>& tables, const SchemaOptions& schemaOptions,
+        const RetryPolicy& retryPolicy, RefreshStats& stats,
+        std::chrono::microseconds window, size_t maxGroupSize, AdmissionController* admission)
+    : mClient(std::move(client))
+    , mService(service)
+    , mStrand(service)
+    , mTimer(service)
+    , mWindow(window)
+    , mMaxGroupSize(std::max(maxGroupSize, size_t(1)))
+    , mTransactions(tables, schemaOptions)
+    , mRetryPolicy(retryPolicy)
+    , mStats(stats)
+    , mAdmission(admission)
+{}
+
+void GroupCommitter::submit(Request request) {
+    std::lock_guard<std::mutex> _(mMutex);
+    mPending.emplace_back(std::move(request));
+    if (mPending.size() >= mMaxGroupSize) {
+        flush();
+    } else if (mPending.size() == 1) {
+        // the first request of a group opens the window, a timer that fired
+        // before a full group flushed its window must not end the next one
+        auto window = mWindows;
+        mTimer.expires_from_now(mWindow);
+        mTimer.async_wait([this, window](const boost::system::error_code& ec) {
+            if (ec)
+                return;
+            std::lock_guard<std::mutex> _(mMutex);
+            if (window == mWindows && !mPending.empty())
+                flush();
+        });
+    }
+}
+
+// has to be called with mMutex held
+void GroupCommitter::flush() {
+    mTimer.cancel();
+    ++mWindows;
+    auto group = std::make_shared<Group>();
+    group->swap(mPending);
+    mStrand.post([this, group]() {
+        run(group, 1);
+    });
+}
+
+// has to be called on the strand
+void GroupCommitter::run(std::shared_ptr<Group> group, unsigned attempt) {
+    if (mAdmission) {
+        mAdmission->admit(mService, mStrand.wrap([this, group, attempt]() {
+            commit(group, attempt);
+        }));
+        return;
+    }
+    commit(group, attempt);
+}
+
+void GroupCommitter::commit(std::shared_ptr<Group> group, unsigned attempt) {
+    LOG_DEBUG("Committing a group of " + std::to_string(group->size()) + " refresh requests");
+    // the fiber is only waited for on the strand, so it is always set by then
+    auto fiber = std::make_shared<std::unique_ptr<TellFiber>>();
+    auto start = std::chrono::steady_clock::now();
+    auto transaction = [this, group, attempt, fiber, start](tell::db::Transaction& tx) {
+        bool success = true;
+        crossbow::string error;
+        try {
+            for (auto& request : *group) {
+                request.apply(tx);
+            }
+        } catch (std::exception& ex) {
+            success = false;
+            error = ex.what();
+        }
+        bool conflict = success && !Transactions::commit(tx, error);
+        mStrand.post([this, group, attempt, fiber, start, success, conflict, error]() {
+            (*fiber)->wait();
+            // the fiber owns the transaction, which holds on to the fiber
+            fiber->reset();
+            if (mAdmission)
+                mAdmission->complete(std::chrono::steady_clock::now() - start, conflict);
+            if (mRetryPolicy.retry(conflict, attempt)) {
+                auto timer = std::make_shared<boost::asio::steady_timer>(mService, mRetryPolicy.backoff(attempt));
+                timer->async_wait(mStrand.wrap([this, group, attempt, timer](const boost::system::error_code&) {
+                    run(group, attempt + 1);
+                }));
+                return;
+            }
+            if (!success && group->size() > 1) {
+                // one broken request must not fail the others, each of them
+                // runs on its own now
+                LOG_DEBUG("Group failed, committing its requests one at a time: " + error);
+                for (auto& request : *group) {
+                    run(std::make_shared<Group>(1, request), 1);
+                }
+                return;
+            }
+            for (auto& request : *group) {
+                request.finish(success && !conflict, conflict, error, attempt);
+            }
+        });
+    };
+    fiber->reset(new TellFiber(mClient->clientManager.startTransaction(transaction)));
+}
+
+} // namespace tpch
@@ -0,0 +1,122 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <common/Protocol.hpp>
+
+#include "RefreshStats.hpp"
+#include "RetryPolicy.hpp"
+#include "Transactions.hpp"
+
+namespace tpch {
+
+class AdmissionController;
+
+/**
+ * Merges the refresh requests of all connections that arrive within a short
+ * window into one Tell transaction, so a group pays for one snapshot and one
+ * commit instead of one per request. A group whose commit conflicted is run
+ * again as a whole. If one of its requests fails, every request of the group
+ * is committed on its own instead, so only the broken one reports an error. Every attempt of a group
+ * is one transaction for the admission controller.
+ */
+class GroupCommitter {
+    struct Request {
+        // applies the request to the transaction of its group
+        std::function<void(tell::db::Transaction&)> apply;
+        // hands the result back to the connection
+        std::function<void(bool success, bool conflict, const crossbow::string& error, unsigned attempts)> finish;
+    };
+    using Group = std::vector<Request>;
+
+    TellClient mClient;
+    boost::asio::io_service& mService;
+    boost::asio::io_service::strand mStrand;
+    boost::asio::steady_timer mTimer;
+    std::chrono::microseconds mWindow;
+    size_t mMaxGroupSize;
+    Transactions mTransactions;
+    const RetryPolicy& mRetryPolicy;
+    RefreshStats& mStats;
+    AdmissionController* mAdmission;
+    std::mutex mMutex;
+    Group mPending;
+    uint64_t mWindows = 0; // flushed windows, tells timers of old windows apart
+
+    void submit(Request request);
+    void flush();
+    void run(std::shared_ptr<Group> group, unsigned attempt);
+    void commit(std::shared_ptr<Group> group, unsigned attempt);
+
+    template<Command C, class In, class Out, class Callback>
+    void submit(boost::asio::io_service& service, const In& in, const Callback& callback,
+            void (Transactions::*apply)(tell::db::Transaction&, const In&, Out&)) {
+        auto result = std::make_shared<Out>();
+        auto start = std::chrono::steady_clock::now();
+        submit(Request{
+            [this, in, result, apply](tell::db::Transaction& tx) {
+                *result = Out();
+                (mTransactions.*apply)(tx, in, *result);
+            },
+            [this, &service, result, callback, start](bool success, bool conflict,
+                    const crossbow::string& error, unsigned attempts) {
+                if (!success) {
+                    result->success = false;
+                    result->conflict = conflict;
+                    result->error = error;
+                    result->affectedRows = 0;
+                }
+                result->attempts = attempts;
+                mStats.record(C, *result, std::chrono::steady_clock::now() - start);
+                service.post([result, callback]() {
+                    callback(*result);
+                });
+            }});
+    }
+public:
+    GroupCommitter(TellClient client, boost::asio::io_service& service, TableCache<Transactions::CachedTable>& tables,
+            const SchemaOptions& schemaOptions, const RetryPolicy& retryPolicy, RefreshStats& stats,
+            std::chrono::microseconds window, size_t maxGroupSize, AdmissionController* admission = nullptr);
+
+    // callback gets called with the result on service
+    template<class Callback>
+    void rf1(boost::asio::io_service& service, const RF1InView& in, const Callback& callback) {
+        submit<Command::RF1>(service, in, callback, &Transactions::insertOrders);
+    }
+
+    template<class Callback>
+    void rf2(boost::asio::io_service& service, const RF2InView& in, const Callback& callback) {
+        submit<Command::RF2>(service, in, callback, &Transactions::deleteOrders);
+    }
+};
+
+} // namespace tpch
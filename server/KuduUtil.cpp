@@ -22,14 +22,20 @@
  */
 #include "KuduUtil.hpp"
 
+#include <memory>
 #include <vector>
 
 #include <crossbow/logger.hpp>
 
+KuduStatusError::KuduStatusError(const Status& status)
+    : std::runtime_error(status.message().ToString().c_str())
+    , mRetryable(status.IsTimedOut() || status.IsServiceUnavailable() || status.IsNetworkError())
+{}
+
 void assertOk(Status status) {
     if (!status.ok()) {
         LOG_ERROR("ERROR from Kudu: %1%", status.message().ToString());
-        throw std::runtime_error(status.message().ToString().c_str());
+        throw KuduStatusError(status);
     }
 }
 
@@ -61,6 +67,48 @@ void set(KuduWriteOperation& upd, const Slice& slice, const Slice& str) {
     assertOk(upd.mutable_row()->SetString(slice, str));
 }
 
+void set(KuduWriteOperation& upd, int column, int16_t v) {
+    assertOk(upd.mutable_row()->SetInt16(column, v));
+}
+
+void set(KuduWriteOperation& upd, int column, int32_t v) {
+    assertOk(upd.mutable_row()->SetInt32(column, v));
+}
+
+void set(KuduWriteOperation& upd, int column, int64_t v) {
+    assertOk(upd.mutable_row()->SetInt64(column, v));
+}
+
+void set(KuduWriteOperation& upd, int column, double v) {
+    assertOk(upd.mutable_row()->SetDouble(column, v));
+}
+
+void set(KuduWriteOperation& upd, int column, const crossbow::string& str) {
+    assertOk(upd.mutable_row()->SetStringCopy(column,
+            Slice(reinterpret_cast<const uint8_t*>(str.c_str()), str.size())));
+}
+
+// copies, as the operation may outlive str if a flush fails
+void set(KuduWriteOperation& upd, int column, const Slice& str) {
+    assertOk(upd.mutable_row()->SetStringCopy(column, str));
+}
+
+std::vector<int> columnIndexes(KuduTable& table, const std::vector<std::string>& columns) {
+    auto& schema = table.schema();
+    std::vector<int> result;
+    for (auto& column : columns) {
+        size_t i = 0;
+        while (i < schema.num_columns() && schema.Column(i).name() != column) {
+            ++i;
+        }
+        if (i == schema.num_columns()) {
+            throw std::runtime_error("Column " + column + " does not exist in " + table.name());
+        }
+        result.emplace_back(int(i));
+    }
+    return result;
+}
+
 void getField(KuduRowResult &row, const std::string &columnName, int16_t &result) {
     assertOk(row.GetInt16(columnName, &result));
 }
@@ -83,12 +131,45 @@ void increaseAffectedRowsAndFlush(int32_t &affectedRows, kudu::client::KuduSessi
         assertOk(session.Flush());
 }
 
-std::vector<const kudu::KuduPartialRow*> createRangePartitioning(int numItems, int partitions, kudu::client::KuduSchema& schema) {
-    std::vector<const kudu::KuduPartialRow*> splits;
+int32_t flushIgnoreNotFound(kudu::client::KuduSession &session) {
+    if (session.Flush().ok())
+        return 0;
+    std::vector<KuduError*> errors;
+    bool overflowed;
+    session.GetPendingErrors(&errors, &overflowed);
+    int32_t notFound = 0;
+    std::unique_ptr<Status> failure;
+    for (auto err : errors) {
+        std::unique_ptr<KuduError> error(err);
+        if (error->status().IsNotFound()) {
+            ++notFound;
+        } else if (!failure) {
+            failure.reset(new Status(error->status()));
+        }
+    }
+    if (overflowed) {
+        throw std::runtime_error("Too many errors on flush, some of them got lost");
+    }
+    if (failure) {
+        assertOk(*failure);
+    }
+    return notFound;
+}
+
+std::vector<int32_t> rangeSplits(int numItems, int partitions) {
+    std::vector<int32_t> splits;
     int increment = numItems / partitions;
     for (int i = 1; i < partitions; ++i) {
+        splits.emplace_back(i*increment);
+    }
+    return splits;
+}
+
+std::vector<const kudu::KuduPartialRow*> createRangePartitioning(int numItems, int partitions, kudu::client::KuduSchema& schema) {
+    std::vector<const kudu::KuduPartialRow*> splits;
+    for (auto key : rangeSplits(numItems, partitions)) {
         auto row = schema.NewRow();
-        assertOk(row->SetInt32(0, i*increment));
+        assertOk(row->SetInt32(0, key));
         splits.emplace_back(row);
     }
     return splits;
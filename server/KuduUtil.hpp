@@ -24,6 +24,8 @@
 
 #include <crossbow/string.hpp>
 
+#include <stdexcept>
+
 #include <kudu/client/client.h>
 #include <kudu/client/row_result.h>
 
@@ -33,6 +35,14 @@ using namespace kudu::client;
 using ScannerList = std::vector<std::unique_ptr<KuduScanner>>;
 using Session = std::tr1::shared_ptr<kudu::client::KuduSession>;
 
+// thrown by assertOk, transient errors like timeouts are retryable
+class KuduStatusError : public std::runtime_error {
+    bool mRetryable;
+public:
+    KuduStatusError(const Status& status);
+    bool retryable() const { return mRetryable; }
+};
+
 void assertOk(Status status);
 
 template<class T>
@@ -129,10 +139,24 @@ void set(KuduWriteOperation& upd, const Slice& slice, double v);
 void set(KuduWriteOperation& upd, const Slice& slice, std::nullptr_t);
 void set(KuduWriteOperation& upd, const Slice& slice, const crossbow::string& str);
 void set(KuduWriteOperation& upd, const Slice& slice, const Slice& str);
+// setters by column index, see columnIndexes
+void set(KuduWriteOperation& upd, int column, int16_t v);
+void set(KuduWriteOperation& upd, int column, int32_t v);
+void set(KuduWriteOperation& upd, int column, int64_t v);
+void set(KuduWriteOperation& upd, int column, double v);
+void set(KuduWriteOperation& upd, int column, const crossbow::string& str);
+void set(KuduWriteOperation& upd, int column, const Slice& str);
+// index of every column in the schema of table
+std::vector<int> columnIndexes(KuduTable& table, const std::vector<std::string>& columns);
 void getField(KuduRowResult &row, const std::string &columnName, int16_t &result);
 void getField(KuduRowResult &row, const std::string &columnName, int32_t &result);
 void getField(KuduRowResult &row, const std::string &columnName, int64_t &result);
 void getField(KuduRowResult &row, const std::string &columnName, double &result);
 void increaseAffectedRowsAndFlush(int32_t &affectedRows, kudu::client::KuduSession &session);
+// flushes the session, fails on every error but rows that do not exist and
+// returns the number of operations that failed because of a missing row
+int32_t flushIgnoreNotFound(kudu::client::KuduSession &session);
 
+// keys at which a table with numItems rows is split into partitions ranges
+std::vector<int32_t> rangeSplits(int numItems, int partitions);
 std::vector<const kudu::KuduPartialRow*> createRangePartitioning(int numItems, int partitions, kudu::client::KuduSchema& schema);
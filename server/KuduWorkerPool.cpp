@@ -0,0 +1,83 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include "KuduWorkerPool.hpp"
+
+#include "KuduUtil.hpp"
+
+#include <crossbow/logger.hpp>
+
+namespace tpch {
+
+namespace {
+
+// session of the worker running on this thread
+thread_local std::tr1::shared_ptr<kudu::client::KuduSession>* workerSession = nullptr;
+
+std::tr1::shared_ptr<kudu::client::KuduSession> newSession(kudu::client::KuduClient& client) {
+    auto session = client.NewSession();
+    assertOk(session->SetFlushMode(kudu::client::KuduSession::MANUAL_FLUSH));
+    session->SetTimeoutMillis(60000);
+    return session;
+}
+
+} // anonymous namespace
+
+KuduWorkerPool::KuduWorkerPool(std::tr1::shared_ptr<kudu::client::KuduClient> client, size_t numWorkers)
+    : mClient(std::move(client))
+    , mWork(new boost::asio::io_service::work(mService))
+{
+    mThreads.reserve(numWorkers);
+    for (size_t i = 0; i < numWorkers; ++i) {
+        mThreads.emplace_back([this]() {
+            auto session = newSession(*mClient);
+            workerSession = &session;
+            mService.run();
+            workerSession = nullptr;
+            assertOk(session->Close());
+        });
+    }
+}
+
+KuduWorkerPool::~KuduWorkerPool() {
+    mWork.reset();
+    for (auto& t : mThreads) {
+        t.join();
+    }
+}
+
+void KuduWorkerPool::post(std::function<void(kudu::client::KuduSession&)> job) {
+    mService.post([this, job]() {
+        auto& session = *workerSession;
+        job(*session);
+        // replacing a session discards what it still holds, it is closed
+        // first so it does not linger until its last reference is gone
+        if (session->HasPendingOperations() || session->CountPendingErrors() > 0) {
+            auto status = session->Close();
+            if (!status.ok())
+                LOG_ERROR("Could not close failed session: %1%", status.message().ToString());
+            session = newSession(*mClient);
+        }
+    });
+}
+
+} // namespace tpch
@@ -0,0 +1,58 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <kudu/client/client.h>
+
+namespace tpch {
+
+/**
+ * Runs Kudu refresh transactions on a fixed number of threads, each of them
+ * with its own session. This keeps the network threads free while a
+ * transaction waits for its RPCs and lets RF concurrency be sized
+ * independently of the number of network threads. A session that a failed
+ * transaction left operations or errors in is replaced, they would go out
+ * with (or be counted by) the next transaction of the worker otherwise.
+ */
+class KuduWorkerPool {
+    std::tr1::shared_ptr<kudu::client::KuduClient> mClient;
+    boost::asio::io_service mService;
+    std::unique_ptr<boost::asio::io_service::work> mWork;
+    std::vector<std::thread> mThreads;
+public:
+    KuduWorkerPool(std::tr1::shared_ptr<kudu::client::KuduClient> client, size_t numWorkers);
+    // waits until all queued jobs are done
+    ~KuduWorkerPool();
+
+    // runs job on one of the workers, the session belongs to that worker
+    void post(std::function<void(kudu::client::KuduSession&)> job);
+};
+
+} // namespace tpch
@@ -0,0 +1,41 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include "RefreshStats.hpp"
+
+namespace tpch {
+
+std::string RefreshStats::report(const char* name, const Counters& counters) {
+    uint64_t retried = counters.retried;
+    auto retryLatency = retried == 0 ? 0 : counters.retriedMicros / retried;
+    return std::string(name) + ": " + std::to_string(counters.committed) + " committed, "
+        + std::to_string(counters.failed) + " failed, "
+        + std::to_string(counters.attempts) + " attempts, "
+        + std::to_string(counters.conflicts) + " conflicts, "
+        + std::to_string(retried) + " retried with " + std::to_string(retryLatency) + "us avg latency";
+}
+
+std::string RefreshStats::report() const {
+    return report("RF1", mRF1) + "; " + report("RF2", mRF2);
+}
+
+} // namespace tpch
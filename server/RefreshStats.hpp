@@ -0,0 +1,70 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <common/Protocol.hpp>
+
+namespace tpch {
+
+/**
+ * Counts the outcome of the refresh transactions of all connections per
+ * transaction type, so concurrency can be tuned for committed throughput.
+ */
+class RefreshStats {
+    struct Counters {
+        std::atomic<uint64_t> committed{0};
+        std::atomic<uint64_t> failed{0};
+        std::atomic<uint64_t> attempts{0};
+        std::atomic<uint64_t> conflicts{0};     // aborted attempts
+        std::atomic<uint64_t> retried{0};       // transactions that needed more than one attempt
+        std::atomic<uint64_t> retriedMicros{0}; // total latency of the retried transactions
+    };
+
+    Counters mRF1;
+    Counters mRF2;
+
+    static std::string report(const char* name, const Counters& counters);
+public:
+    // latency is the time from the first attempt until the result
+    template<class Out>
+    void record(Command type, const Out& result, std::chrono::steady_clock::duration latency) {
+        auto& counters = type == Command::RF1 ? mRF1 : mRF2;
+        (result.success ? counters.committed : counters.failed)++;
+        counters.attempts += result.attempts;
+        counters.conflicts += result.attempts - 1 + (result.conflict ? 1 : 0);
+        if (result.attempts > 1) {
+            counters.retried++;
+            counters.retriedMicros += std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+        }
+    }
+
+    // one line with the totals since the server was started
+    std::string report() const;
+};
+
+} // namespace tpch
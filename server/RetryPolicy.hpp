@@ -0,0 +1,55 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace tpch {
+
+/**
+ * Decides whether a refresh transaction that failed because of a conflict
+ * is run again and how long to wait before. The backoff doubles with every
+ * attempt up to a maximum and the actual wait is drawn uniformly below it, so
+ * transactions that conflicted with each other do not retry in lockstep.
+ */
+struct RetryPolicy {
+    unsigned maxAttempts = 5; // 1 disables retries
+    std::chrono::microseconds baseBackoff{500};
+    std::chrono::microseconds maxBackoff{50000};
+
+    bool retry(bool conflict, unsigned attempt) const {
+        return conflict && attempt < maxAttempts;
+    }
+
+    // wait before the attempt after the given one
+    std::chrono::microseconds backoff(unsigned attempt) const {
+        thread_local std::mt19937 rnd(std::random_device{}());
+        auto limit = std::min(maxBackoff.count(), baseBackoff.count() << std::min(attempt - 1, 20u));
+        std::uniform_int_distribution<decltype(limit)> dist(0, limit);
+        return std::chrono::microseconds(dist(rnd));
+    }
+};
+
+} // namespace tpch
@@ -0,0 +1,76 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace tpch {
+
+/**
+ * Caches what refresh transactions resolve about their tables, e.g. handles
+ * and column ids, by table name for all connections of a server. Creating
+ * the schema clears it, entries resolved while the schema got created are
+ * not kept.
+ */
+template<class Handle>
+class TableCache {
+    std::mutex mMutex;
+    std::unordered_map<std::string, Handle> mTables;
+    uint64_t mGeneration = 0; // counts the clears
+public:
+    // returns the cached handle or resolves it with open(name), open gets
+    // called without holding the lock as it usually waits for the storage
+    template<class Open>
+    Handle get(const std::string& name, Open open) {
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> _(mMutex);
+            auto iter = mTables.find(name);
+            if (iter != mTables.end())
+                return iter->second;
+            generation = mGeneration;
+        }
+        Handle handle = open(name);
+        std::lock_guard<std::mutex> _(mMutex);
+        if (generation != mGeneration)
+            return handle;
+        return mTables.emplace(name, std::move(handle)).first->second;
+    }
+
+    // replaces a handle the caller found to be stale
+    void put(const std::string& name, Handle handle) {
+        std::lock_guard<std::mutex> _(mMutex);
+        mTables[name] = std::move(handle);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> _(mMutex);
+        mTables.clear();
+        ++mGeneration;
+    }
+};
+
+} // namespace tpch
@@ -22,133 +22,234 @@
  */
 #include "Transactions.hpp"
 
+#include <telldb/Exceptions.hpp>
+
 using namespace tell::db;
 
 namespace tpch {
 
-RF1Out Transactions::rf1(tell::db::Transaction &tx, const RF1In &in)
+namespace {
+
+// sets the fields of a tuple to insert, columns are positions in the table
+// descriptor and get mapped to the column ids of the table
+struct TupleBuilder {
+    Tuple& tuple;
+    const std::vector<tell::store::Schema::id_t>& columnIds;
+
+    template<class T>
+    void operator() (size_t column, const T& value) {
+        tuple[columnIds[column]] = Field(value);
+    }
+
+    // TellDB fields own their strings
+    void operator() (size_t column, const StringView& value) {
+        tuple[columnIds[column]] = Field(crossbow::string(value.data, value.length));
+    }
+};
+
+// a tuple that gets deleted once it is fetched
+struct PendingDelete {
+    int32_t orderId;
+    tell::db::key_t key;
+    Future<Tuple> tuple;
+};
+
+} // anonymous namespace
+
+// TellDB only knows a table in the client context of the transaction that
+// opened it, so every transaction opens its tables itself; only the first
+// open goes to the storage. What is shared are the column ids, resolved
+// again only when the table was created anew, e.g. by another server.
+template<class Table>
+Transactions::CachedTable Transactions::openTable(tell::db::Transaction& tx) {
+    std::string name = Table::name();
+    auto id = tx.openTable(crossbow::string(name.c_str(), name.size())).get();
+    auto resolve = [&tx, id](const std::string&) {
+        CachedTable table{id, {}};
+        auto& schema = tx.getSchema(id);
+        for (auto& column : Table::columns()) {
+            table.columnIds.emplace_back(schema.idOf(column.name));
+        }
+        return table;
+    };
+    auto table = mTables.get(name, resolve);
+    if (table.id != id) {
+        table = resolve(name);
+        mTables.put(name, table);
+    }
+    return table;
+}
+
+bool Transactions::commit(tell::db::Transaction& tx, crossbow::string& error) {
+    try {
+        tx.commit();
+        return true;
+    } catch (std::exception& ex) {
+        error = ex.what();
+        return false;
+    }
+}
+
+RF1Out Transactions::rf1(tell::db::Transaction &tx, const RF1InView &in)
 {
     RF1Out result;
 
     try {
-        auto oFuture = tx.openTable("orders");
-        auto lFuture = tx.openTable("lineitem");
-
-        auto lTable = lFuture.get();
-        auto oTable = oFuture.get();
-
-        tell::db::Counter orderCounter(tx.getCounter("orders_counter"));
-        tell::db::Counter lineitemCounter(tx.getCounter("lineitem_counter"));
-
-        for (auto &order: in.orders) {
-            tx.insert(oTable, tell::db::key_t{orderCounter.next()},
-                    {{
-                    {"o_orderkey", order.orderkey},
-                    {"o_custkey", order.custkey},
-                    {"o_orderstatus", order.orderstatus},
-                    {"o_totalprice", order.totalprice},
-                    {"o_orderdate", order.orderdate},
-                    {"o_orderpriority", order.orderpriority},
-                    {"o_clerk", order.clerk},
-                    {"o_shippriority", order.shippriority},
-                    {"o_comment", order.comment}
-                    }});
-            result.affectedRows++;
-            for (auto &line: order.lineitems) {
-                tx.insert(lTable, tell::db::key_t{lineitemCounter.next()},
-                    {{
-                    {"l_orderkey", line.orderkey},
-                    {"l_partkey", line.partkey},
-                    {"l_suppkey", line.suppkey},
-                    {"l_linenumber", line.linenumber},
-                    {"l_quantity", line.quantity},
-                    {"l_extendedprice", line.extendedprice},
-                    {"l_discount", line.discount},
-                    {"l_tax", line.tax},
-                    {"l_returnflag", line.returnflag},
-                    {"l_linestatus", line.linestatus},
-                    {"l_shipdate", line.shipdate},
-                    {"l_commitdate", line.commitdate},
-                    {"l_receiptdate", line.receiptdate},
-                    {"l_shipinstruct", line.shipinstruct},
-                    {"l_shipmode", line.shipmode},
-                    {"l_comment", line.comment},
-                    }});
-                result.affectedRows++;
-            }
-        }
-        tx.commit();
+        insertOrders(tx, in, result);
     } catch (std::exception& ex) {
         result.success = false;
         result.error = ex.what();
+        return result;
+    }
+    if (!commit(tx, result.error)) {
+        result.success = false;
+        result.conflict = true;
     }
 
     return result;
 }
 
-RF2Out Transactions::rf2(tell::db::Transaction &tx, const RF2In &in)
+RF2Out Transactions::rf2(tell::db::Transaction &tx, const RF2InView &in)
 {
     RF2Out result;
 
     try {
-        auto oFuture = tx.openTable("orders");
-        auto lFuture = tx.openTable("lineitem");
-
-        auto lTable = lFuture.get();
-        auto oTable = oFuture.get();
-
-        std::vector<Future<Tuple>> oTupleFutures;
-        oTupleFutures.reserve(in.orderIds.size());
-        std::vector<tell::db::key_t> orderKeys;
-        orderKeys.reserve(in.orderIds.size());
-
-        // get futures in reverse order
-        for (auto orderIdIter = in.orderIds.rbegin(); orderIdIter < in.orderIds.rend(); ++orderIdIter) {
-            auto lower = tx.lower_bound(oTable, "o_orderkey_idx", {Field(int32_t(*orderIdIter))});
-            if (lower.done()) {
-                LOG_ERROR("order with orderkey " + std::to_string(*orderIdIter) + "could not be deleted because it does not exist!");
-            }
-            orderKeys.emplace_back(lower.value());
-            oTupleFutures.emplace_back(tx.get(oTable, orderKeys.back()));
+        deleteOrders(tx, in, result);
+    } catch (std::exception& ex) {
+        result.success = false;
+        result.error = ex.what();
+        return result;
+    }
+    if (!commit(tx, result.error)) {
+        result.success = false;
+        result.conflict = true;
+    }
+
+    return result;
+}
+
+void Transactions::insertOrders(tell::db::Transaction &tx, const RF1InView &in, RF1Out& result)
+{
+    auto oTable = openTable<OrdersTable>(tx);
+    auto lTable = openTable<LineitemTable>(tx);
+
+    // with natural keys the tuple keys are derived from the orderkey
+    std::unique_ptr<tell::db::Counter> orderCounter;
+    std::unique_ptr<tell::db::Counter> lineitemCounter;
+    if (!mSchemaOptions.naturalKeys) {
+        orderCounter.reset(new tell::db::Counter(tx.getCounter("orders_counter")));
+        lineitemCounter.reset(new tell::db::Counter(tx.getCounter("lineitem_counter")));
+    }
+
+    for (auto &order: in.orders) {
+        auto orderKey = orderCounter ? orderCounter->next() : orderTupleKey(order.orderkey);
+        auto oTuple = tx.newTuple(oTable.id);
+        TupleBuilder o{oTuple, oTable.columnIds};
+        writeRow<crossbow::string>(o, OrdersTable::fromOrder(order), mSchemaOptions);
+        tx.insert(oTable.id, tell::db::key_t{orderKey}, oTuple);
+        result.affectedRows++;
+        for (auto &line: order.lineitems) {
+            auto lineitemKey = lineitemCounter ? lineitemCounter->next()
+                    : lineitemTupleKey(line.orderkey, line.linenumber);
+            auto lTuple = tx.newTuple(lTable.id);
+            TupleBuilder l{lTuple, lTable.columnIds};
+            writeRow<crossbow::string>(l, LineitemTable::fromLineitem(line), mSchemaOptions);
+            tx.insert(lTable.id, tell::db::key_t{lineitemKey}, lTuple);
+            result.affectedRows++;
         }
+    }
+}
 
-        auto orderKeyIter = orderKeys.rbegin();
-        int orderIdx = 0;
-        // get the actual values in reverse reverse = actual order
-        for (auto iter = oTupleFutures.rbegin();
-                    iter < oTupleFutures.rend(); ++iter, ++orderKeyIter, ++orderIdx) {
-            // remove order
-            tx.remove(oTable, *orderKeyIter, iter->get());
+void Transactions::deleteOrders(tell::db::Transaction &tx, const RF2InView &in, RF2Out& result)
+{
+    auto oTable = openTable<OrdersTable>(tx);
+    auto lTable = openTable<LineitemTable>(tx);
+
+    if (mSchemaOptions.naturalKeys) {
+        deleteByKey(tx, oTable.id, lTable.id, in, result);
+    } else {
+        deleteByIndex(tx, oTable.id, lTable.id, in, result);
+    }
+}
+
+void Transactions::deleteByIndex(tell::db::Transaction& tx, table_t oTable, table_t lTable,
+        const RF2InView& in, RF2Out& result)
+{
+    // only the tuple fetches of the batch overlap: they are all requested
+    // before waiting for the first one. TellDB index iterators are
+    // synchronous, so the two probes per order still run one after another.
+    ArenaVector<PendingDelete> orders(in.arena());
+    orders.reserve(in.orderIds.size());
+    ArenaVector<PendingDelete> lineitems(in.arena());
+    lineitems.reserve(7 * in.orderIds.size());
+    for (auto orderId : in.orderIds) {
+        auto lower = tx.lower_bound(oTable, "o_orderkey_idx", {Field(orderId)});
+        if (lower.done()) {
+            LOG_ERROR("order with orderkey " + std::to_string(orderId) + " could not be deleted because it does not exist!");
+            continue;
+        }
+        orders.emplace_back(PendingDelete{orderId, lower.value(), tx.get(oTable, lower.value())});
+        auto lineIter = tx.lower_bound(lTable, "l_orderkey_idx", {Field(orderId)});
+        for (uint counter = 0; !lineIter.done() && counter < 7; ++counter, lineIter.next()) {
+            lineitems.emplace_back(PendingDelete{orderId, lineIter.value(), tx.get(lTable, lineIter.value())});
+        }
+    }
+
+    // the index returns the next greater key for missing orders and the
+    // lines of the following order after the last line of an order
+    for (auto& order : orders) {
+        auto& tuple = order.tuple.get();
+        if (tuple["o_orderkey"] == order.orderId) {
+            tx.remove(oTable, order.key, tuple);
             result.affectedRows++;
-            // collect tuple futures for lineitems that might get deleted
-            auto &orderKey = in.orderIds[orderIdx];
-            std::vector<Future<Tuple>> lTupleFutures;
-            auto lineIter = tx.lower_bound(lTable, "l_orderkey_idx", {Field(orderKey)});
-            uint counter = 0;
-            std::vector<tell::db::key_t> lineitemKeys;
-            lineitemKeys.reserve(7);
-            while (!lineIter.done() && counter++ < 7) {
-                lineitemKeys.emplace_back(lineIter.value());
-                lTupleFutures.emplace_back(tx.get(lTable, lineitemKeys.back()));
-                lineIter.next();
-            }
-            // delete lineitems if necessary
-            auto lKeyIter = lineitemKeys.rbegin();
-            for (auto lFutureIter = lTupleFutures.rbegin(); lFutureIter < lTupleFutures.rend(); ++lFutureIter, ++lKeyIter) {
-                auto & lineitem = lFutureIter->get();
-                if (lineitem["l_orderkey"] == orderKey) {
-                    tx.remove(lTable, *lKeyIter, lineitem);
-                    result.affectedRows++;
-                }
-            }
         }
+    }
+    for (auto& lineitem : lineitems) {
+        auto& tuple = lineitem.tuple.get();
+        if (tuple["l_orderkey"] == lineitem.orderId) {
+            tx.remove(lTable, lineitem.key, tuple);
+            result.affectedRows++;
+        }
+    }
+}
 
-    } catch (std::exception& ex) {
-        result.success = false;
-        result.error = ex.what();
+void Transactions::deleteByKey(tell::db::Transaction& tx, table_t oTable, table_t lTable,
+        const RF2InView& in, RF2Out& result)
+{
+    // request all tuples of the batch before waiting for the first one, as the
+    // line numbers are not known, we request all 7 possible lineitems
+    ArenaVector<Future<Tuple>> oTupleFutures(in.arena());
+    oTupleFutures.reserve(in.orderIds.size());
+    ArenaVector<Future<Tuple>> lTupleFutures(in.arena());
+    lTupleFutures.reserve(7 * in.orderIds.size());
+    for (auto orderId : in.orderIds) {
+        oTupleFutures.emplace_back(tx.get(oTable, tell::db::key_t{orderTupleKey(orderId)}));
+        for (int32_t linenumber = 1; linenumber <= 7; ++linenumber) {
+            lTupleFutures.emplace_back(tx.get(lTable, tell::db::key_t{lineitemTupleKey(orderId, linenumber)}));
+        }
     }
 
-    return result;
+    for (size_t orderIdx = 0; orderIdx < in.orderIds.size(); ++orderIdx) {
+        auto orderId = in.orderIds[orderIdx];
+        try {
+            tx.remove(oTable, tell::db::key_t{orderTupleKey(orderId)}, oTupleFutures[orderIdx].get());
+            result.affectedRows++;
+        } catch (tell::db::TupleDoesNotExistException&) {
+            LOG_ERROR("order with orderkey " + std::to_string(orderId) + " could not be deleted because it does not exist!");
+        }
+        for (int32_t linenumber = 1; linenumber <= 7; ++linenumber) {
+            const Tuple* lineitem;
+            try {
+                lineitem = &lTupleFutures[7 * orderIdx + linenumber - 1].get();
+            } catch (tell::db::TupleDoesNotExistException&) {
+                // getting a line number the order does not have fails, any
+                // other error aborts the attempt
+                continue;
+            }
+            tx.remove(lTable, tell::db::key_t{lineitemTupleKey(orderId, linenumber)}, *lineitem);
+            result.affectedRows++;
+        }
+    }
 }
 
 } // namespace tpch
@@ -21,16 +21,52 @@
  *     Lucas Braun <braunl@inf.ethz.ch>
  */
 #pragma once
+#include <vector>
+
 #include <telldb/Transaction.hpp>
 #include <common/Protocol.hpp>
 
+#include "CreatePopulate.hpp"
+#include "TableCache.hpp"
+
 namespace tpch {
 
 class Transactions {
+public:
+    // a table as refresh transactions use it, the column ids are in the order
+    // of the table descriptor
+    struct CachedTable {
+        tell::db::table_t id;
+        std::vector<tell::store::Schema::id_t> columnIds;
+    };
+private:
+    TableCache<CachedTable>& mTables;
+    const SchemaOptions& mSchemaOptions;
 
+    template<class Table>
+    CachedTable openTable(tell::db::Transaction& tx);
+    // deletes the orders and their lineitems found through the orderkey indexes
+    void deleteByIndex(tell::db::Transaction& tx, tell::db::table_t oTable, tell::db::table_t lTable,
+            const RF2InView& in, RF2Out& result);
+    // deletes the orders and their lineitems by their natural tuple keys
+    void deleteByKey(tell::db::Transaction& tx, tell::db::table_t oTable, tell::db::table_t lTable,
+            const RF2InView& in, RF2Out& result);
 public:
-    RF1Out rf1(tell::db::Transaction& tx, const RF1In& in);
-    RF2Out rf2(tell::db::Transaction& tx, const RF2In& in);
+    Transactions(TableCache<CachedTable>& tables, const SchemaOptions& schemaOptions)
+        : mTables(tables)
+        , mSchemaOptions(schemaOptions)
+    {}
+
+    RF1Out rf1(tell::db::Transaction& tx, const RF1InView& in);
+    RF2Out rf2(tell::db::Transaction& tx, const RF2InView& in);
+
+    // a failing commit means that the transaction conflicted with another
+    // one, so it can be run again
+    static bool commit(tell::db::Transaction& tx, crossbow::string& error);
+
+    // apply a refresh function without committing, errors are thrown
+    void insertOrders(tell::db::Transaction& tx, const RF1InView& in, RF1Out& result);
+    void deleteOrders(tell::db::Transaction& tx, const RF2InView& in, RF2Out& result);
 
 };
 
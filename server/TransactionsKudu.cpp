@@ -28,111 +28,126 @@
 #include <crossbow/logger.hpp>
 
 #include "KuduUtil.hpp"
+#include "CreatePopulate.hpp"
 
 using namespace kudu;
 using namespace kudu::client;
 
 namespace tpch {
 
-RF1Out TransactionsKudu::rf1(kudu::client::KuduSession &session, const RF1In &in)
+namespace {
+
+// TPC-H orders have between 1 and 7 lineitems
+constexpr int32_t maxLinenumber = 7;
+
+// sets the columns of a row, columns are positions in a table descriptor
+// and get mapped to Kudu column indexes
+struct RowSetter {
+    KuduWriteOperation& op;
+    const std::vector<int>& columnIds;
+
+    template<class T>
+    void operator() (size_t column, const T& value) {
+        set(op, columnIds[column], value);
+    }
+
+    void operator() (size_t column, const StringView& value) {
+        set(op, columnIds[column], Slice(reinterpret_cast<const uint8_t*>(value.data), value.length));
+    }
+};
+
+} // anonymous namespace
+
+template<class Table>
+TransactionsKudu::CachedTable TransactionsKudu::openTable(KuduSession& session) {
+    return mTables.get(Table::name(), [&session](const std::string& name) {
+        CachedTable table;
+        assertOk(session.client()->OpenTable(name, &table.table));
+        table.columnIds = columnIndexes(*table.table, columnNames<Table>());
+        return table;
+    });
+}
+
+RF1Out TransactionsKudu::rf1(kudu::client::KuduSession &session, const RF1InView &in)
 {
     RF1Out result;
     LOG_DEBUG("Starting RF1 with " + std::to_string(in.orders.size()) + " orders.");
 
     try {
-        std::tr1::shared_ptr<KuduTable> oTable;
-        assertOk(session.client()->OpenTable("orders", &oTable));
-        std::tr1::shared_ptr<KuduTable> lTable;
-        assertOk(session.client()->OpenTable("lineitem", &lTable));
+        auto oTable = openTable<OrdersTable>(session);
+        auto lTable = openTable<LineitemTable>(session);
 
         for (auto &order: in.orders) {
-            std::unique_ptr<KuduWriteOperation> oIns(oTable->NewInsert());
-            set(*oIns, "o_orderkey", order.orderkey);
-            set(*oIns, "o_custkey", order.custkey);
-            set(*oIns, "o_orderstatus", order.orderstatus);
-            set(*oIns, "o_totalprice", order.totalprice);
-            set(*oIns, "o_orderdate", order.orderdate);
-            set(*oIns, "o_orderpriority", order.orderpriority);
-            set(*oIns, "o_clerk", order.clerk);
-            set(*oIns, "o_shippriority", order.shippriority);
-            set(*oIns, "o_comment", order.comment);
+            std::unique_ptr<KuduWriteOperation> oIns(oTable.table->NewInsert());
+            RowSetter o{*oIns, oTable.columnIds};
+            writeRow<crossbow::string>(o, OrdersTable::fromOrder(order), mSchemaOptions);
             assertOk(session.Apply(oIns.release()));
             increaseAffectedRowsAndFlush(result.affectedRows, session);
 
             for (auto &line: order.lineitems) {
-                std::unique_ptr<KuduWriteOperation> lIns(lTable->NewInsert());
-                set(*lIns, "l_orderkey", line.orderkey);
-                set(*lIns, "l_partkey", line.partkey);
-                set(*lIns, "l_suppkey", line.suppkey);
-                set(*lIns, "l_linenumber", line.linenumber);
-                set(*lIns, "l_quantity", line.quantity);
-                set(*lIns, "l_extendedprice", line.extendedprice);
-                set(*lIns, "l_discount", line.discount);
-                set(*lIns, "l_tax", line.tax);
-                set(*lIns, "l_returnflag", line.returnflag);
-                set(*lIns, "l_linestatus", line.linestatus);
-                set(*lIns, "l_shipdate", line.shipdate);
-                set(*lIns, "l_commitdate", line.commitdate);
-                set(*lIns, "l_receiptdate", line.receiptdate);
-                set(*lIns, "l_shipinstruct", line.shipinstruct);
-                set(*lIns, "l_shipmode", line.shipmode);
-                set(*lIns, "l_comment", line.comment);
+                std::unique_ptr<KuduWriteOperation> lIns(lTable.table->NewInsert());
+                RowSetter l{*lIns, lTable.columnIds};
+                writeRow<crossbow::string>(l, LineitemTable::fromLineitem(line), mSchemaOptions);
                 assertOk(session.Apply(lIns.release()));
                 increaseAffectedRowsAndFlush(result.affectedRows, session);
             }
         }
         assertOk(session.Flush());
     } catch (std::exception& ex) {
+        // inserts that got through would fail a second attempt, so errors are
+        // never reported as conflicts, another server may have created the
+        // tables anew, so they get opened again
         result.success = false;
         result.error = ex.what();
+        mTables.clear();
     }
 
     LOG_DEBUG("Finishing RF1, " + std::to_string(result.affectedRows) + " rows affected.");
     return result;
 }
 
-RF2Out TransactionsKudu::rf2(kudu::client::KuduSession &session, const RF2In &in)
+RF2Out TransactionsKudu::rf2(kudu::client::KuduSession &session, const RF2InView &in)
 {
     RF2Out result;
     LOG_DEBUG("Starting RF2 with " + std::to_string(in.orderIds.size()) + " orders to delete.");
 
     try {
-        std::tr1::shared_ptr<KuduTable> oTable;
-        assertOk(session.client()->OpenTable("orders", &oTable));
-        std::tr1::shared_ptr<KuduTable> lTable;
-        assertOk(session.client()->OpenTable("lineitem", &lTable));
-
-        std::vector<std::string> projection;
-        projection.push_back("l_orderkey");
-        projection.push_back("l_linenumber");
-
+        auto oTable = openTable<OrdersTable>(session).table;
+        auto lTable = openTable<LineitemTable>(session).table;
+
+        // lineitem is keyed by (l_orderkey, l_linenumber) and an order has at
+        // most 7 lines, so we blindly delete all possible keys instead of
+        // scanning for the lines of every order and ignore missing rows
+        int32_t applied = 0;
+        int32_t notFound = 0;
         for (int32_t orderId: in.orderIds) {
             std::unique_ptr<KuduWriteOperation> oDel(oTable->NewDelete());
             set(*oDel, "o_orderkey", orderId);
             assertOk(session.Apply(oDel.release()));
-            increaseAffectedRowsAndFlush(result.affectedRows, session);
-
-            ScannerList scanners;
-            std::vector<KuduRowResult> resultBatch;
-            KuduScanner &scanner = openScan(*lTable, scanners, projection, "l_orderkey", orderId, KuduPredicate::EQUAL);
-            while (scanner.HasMoreRows()) {
-                assertOk(scanner.NextBatch(&resultBatch));
-                int32_t orderkey;
-                int32_t linenumber;
-                for (KuduRowResult row : resultBatch) {
-                    getField(row, "l_orderkey", orderkey);
-                    getField(row, "l_linenumber", linenumber);
-                    std::unique_ptr<KuduWriteOperation> lDel(lTable->NewDelete());
-                    set(*lDel, "l_orderkey", orderkey);
-                    set(*lDel, "l_linenumber", linenumber);
-                    assertOk(session.Apply(lDel.release()));
-                    increaseAffectedRowsAndFlush(result.affectedRows, session);
-                }
+            ++applied;
+
+            for (int32_t linenumber = 1; linenumber <= maxLinenumber; ++linenumber) {
+                std::unique_ptr<KuduWriteOperation> lDel(lTable->NewDelete());
+                set(*lDel, "l_orderkey", orderId);
+                set(*lDel, "l_linenumber", linenumber);
+                assertOk(session.Apply(lDel.release()));
+                if (!(++applied % 1000))
+                    notFound += flushIgnoreNotFound(session);
             }
         }
+        notFound += flushIgnoreNotFound(session);
+        result.affectedRows = applied - notFound;
+    } catch (KuduStatusError& ex) {
+        // the deletes are idempotent, so running them again is safe
+        result.success = false;
+        result.conflict = ex.retryable();
+        result.error = ex.what();
+        if (!result.conflict)
+            mTables.clear();
     } catch (std::exception& ex) {
         result.success = false;
         result.error = ex.what();
+        mTables.clear();
     }
 
     LOG_DEBUG("Finishing RF2, " + std::to_string(result.affectedRows) + " rows affected.");
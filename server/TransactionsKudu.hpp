@@ -26,13 +26,33 @@
 
 #include <kudu/client/client.h>
 
+#include "CreatePopulate.hpp"
+#include "TableCache.hpp"
+
 namespace tpch {
 
 class TransactionsKudu {
-
 public:
-    RF1Out rf1(kudu::client::KuduSession& session, const RF1In& in);
-    RF2Out rf2(kudu::client::KuduSession& session, const RF2In& in);
+    // a table handle with the Kudu column indexes in the order of the table
+    // descriptor
+    struct CachedTable {
+        std::tr1::shared_ptr<kudu::client::KuduTable> table;
+        std::vector<int> columnIds;
+    };
+private:
+    TableCache<CachedTable>& mTables;
+    const SchemaOptions& mSchemaOptions;
+
+    template<class Table>
+    CachedTable openTable(kudu::client::KuduSession& session);
+public:
+    TransactionsKudu(TableCache<CachedTable>& tables, const SchemaOptions& schemaOptions)
+        : mTables(tables)
+        , mSchemaOptions(schemaOptions)
+    {}
+
+    RF1Out rf1(kudu::client::KuduSession& session, const RF1InView& in);
+    RF2Out rf2(kudu::client::KuduSession& session, const RF2InView& in);
 
 };
 
@@ -24,34 +24,139 @@
 #include <crossbow/program_options.hpp>
 #include <crossbow/logger.hpp>
 #include <telldb/TellDB.hpp>
+#include <common/Arena.hpp>
+#include <common/BufferPool.hpp>
+#include <common/Compression.hpp>
+#include <common/UpdateSets.hpp>
 
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <iostream>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
+#include "AdmissionControl.hpp"
 #include "Connection.hpp"
+#include "GroupCommit.hpp"
+#ifdef USE_KUDU
+#include "KuduWorkerPool.hpp"
+#endif
 
 using namespace crossbow::program_options;
 using namespace boost::asio;
 
+// accepts connections onto the services in turn
 template<class ClientType, class FiberType>
-void accept(boost::asio::io_service &service,
-        boost::asio::ip::tcp::acceptor &a,
-        ClientType& client,
-        tpch::DBGenerator<ClientType, FiberType>& generator,
-        int partitions) {
-    auto conn = new tpch::Connection<ClientType, FiberType>(service, client, generator, partitions);
-    a.async_accept(conn->socket(), [conn, &service, &a, &client, &generator, partitions](const boost::system::error_code &err) {
+void accept(tpch::Listener& listener, const std::vector<io_service*>& services, size_t next,
+        tpch::ServerContext<ClientType, FiberType>& context) {
+    listener.accept(*services[next % services.size()], [&listener, &services, next, &context](
+            const boost::system::error_code &err, std::unique_ptr<tpch::Stream> stream) {
         if (err) {
-            delete conn;
             LOG_ERROR(err.message());
             return;
         }
+        auto conn = new tpch::Connection<ClientType, FiberType>(std::move(stream), context);
         conn->run();
-        accept(service, a, client, generator, partitions);
+        accept(listener, services, next + 1, context);
     });
 }
 
+// an event loop, the connections it gets are only ever served by its own
+// threads
+struct EventLoop {
+    io_service service;
+    io_service::work work;
+    // a listener and the loops it hands its connections to, TCP listeners
+    // share the port with SO_REUSEPORT and each serves its own loop
+    std::unique_ptr<tpch::Listener> listener;
+    std::vector<io_service*> services;
+
+    EventLoop()
+        : work(service)
+    {}
+};
+
+// makes run return, stopping only the loop of a connection would leave the
+// other loops running
+void stopAll(std::vector<std::unique_ptr<EventLoop>>& loops) {
+    for (auto& loop : loops) {
+        loop->service.stop();
+    }
+}
+
+// starts accepting on every loop and runs each loop on threadsPerLoop threads
+// until all of them stopped
+template<class ClientType, class FiberType>
+void run(std::vector<std::unique_ptr<EventLoop>>& loops, size_t threadsPerLoop,
+        tpch::ServerContext<ClientType, FiberType>& context) {
+    std::vector<std::thread> threads;
+    for (auto& loop : loops) {
+        if (loop->listener)
+            accept(*loop->listener, loop->services, 0, context);
+        for (size_t i = 0; i < threadsPerLoop; ++i) {
+            auto& service = loop->service;
+            threads.emplace_back([&service]() {
+                service.run();
+            });
+        }
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+// logs the refresh statistics every interval
+void logStats(boost::asio::steady_timer& timer, const tpch::RefreshStats& stats, std::chrono::seconds interval,
+        tpch::AdmissionController* admission) {
+    timer.expires_from_now(interval);
+    timer.async_wait([&timer, &stats, interval, admission](const boost::system::error_code& ec) {
+        if (ec)
+            return;
+        LOG_INFO(stats.report());
+        if (admission)
+            LOG_INFO(admission->report());
+        LOG_INFO(tpch::Arena::report());
+        LOG_INFO(tpch::BufferPool::shared().report());
+        LOG_INFO(tpch::compressionReport());
+        logStats(timer, stats, interval, admission);
+    });
+}
+
+// parses a comma-separated list of hash bucket counts, an entry is either
+// table:buckets or just a number which then applies to all other tables
+void parseHashBuckets(const std::string& str, tpch::SchemaOptions& options) {
+    static const std::unordered_set<std::string> known = {"part", "supplier", "partsupp", "customer",
+            "orders", "lineitem", "nation", "region"};
+    for (auto& entry : tpch::split(str, ',')) {
+        auto parts = tpch::split(entry, ':');
+        if (parts.size() == 1) {
+            options.hashBuckets = std::stoi(parts[0]);
+        } else if (parts.size() == 2) {
+            if (known.count(parts[0]) == 0)
+                throw std::invalid_argument("Unknown table " + parts[0]);
+            options.tableHashBuckets[parts[0]] = std::stoi(parts[1]);
+        } else {
+            throw std::invalid_argument("Invalid hash bucket specification " + entry);
+        }
+    }
+}
+
+// parses a comma-separated list of the optional indexes of createLineitem
+void parseIndexes(const std::string& str, tpch::SchemaOptions& options) {
+    static const std::unordered_set<std::string> known = {"l_orderkey_linenumber_idx", "l_shipdate_idx"};
+    for (auto& index : tpch::split(str, ',')) {
+        if (index.empty())
+            continue;
+        if (known.count(index) == 0)
+            throw std::invalid_argument("Unknown index " + index);
+        options.indexes.insert(index);
+    }
+}
+
 int main(int argc, const char** argv) {
     bool help = false;
     std::string host;
@@ -60,18 +165,56 @@ int main(int argc, const char** argv) {
     std::string commitManager;
     std::string storageNodes;
     size_t numThreads = 4;
+    size_t eventLoops = 1;
+    std::string transport("tcp");
+    size_t rfWorkers = 4;
+    size_t maxInFlight = 16;
+    unsigned groupCommitWindow = 0;
+    size_t groupCommitSize = 32;
+    tpch::RetryPolicy retryPolicy;
+    unsigned backoff = retryPolicy.baseBackoff.count();
+    unsigned maxBackoff = retryPolicy.maxBackoff.count();
+    unsigned statsInterval = 10;
+    unsigned admissionLatency = 0;
+    unsigned admissionAbortPercent = 10;
+    size_t admissionMax = 256;
+    std::string updateDir;
     int partitions = -1;
+    std::string hashBuckets;
+    bool routedLoad = false;
+    bool naturalKeys = false;
+    std::string indexes;
+    bool compactTypes = false;
     bool useKudu = false;
     auto opts = create_options("tpch_server",
             value<'h'>("help", &help, tag::description{"print help"}),
-            value<'H'>("host", &host, tag::description{"Host to bind to"}),
+            value<'H'>("host", &host, tag::description{"Host to bind to, or the socket path for the unix and shm transports"}),
             value<'p'>("port", &port, tag::description{"Port to bind to"}),
             value<'P'>("partitions", &partitions, tag::description{"Number of partitions per table"}),
+            value<'B'>("hash-buckets", &hashBuckets, tag::description{"Number of hash buckets per table, either a number or a comma-separated list of table:buckets"}),
             value<'l'>("log-level", &logLevel, tag::description{"The log level"}),
             value<'c'>("commit-manager", &commitManager, tag::description{"Address to the commit manager"}),
             value<'s'>("storage-nodes", &storageNodes, tag::description{"Semicolon-separated list of storage node addresses"}),
             value<'k'>("kudu", &useKudu, tag::description{"use kudu instead of TellStore"}),
-            value<-1>("network-threads", &numThreads, tag::ignore_short<true>{})
+            value<-1>("routed-load", &routedLoad, tag::description{"Buffer populate inserts per range partition (Kudu), not with hash buckets"}),
+            value<-1>("natural-keys", &naturalKeys, tag::description{"Key orders and lineitem by orderkey instead of counters (Tell)"}),
+            value<-1>("compact-types", &compactTypes, tag::description{"Store dates as days, decimals as hundredths and flags as SMALLINT"}),
+            value<-1>("indexes", &indexes, tag::description{"Comma-separated list of optional indexes to create, l_orderkey_linenumber_idx or l_shipdate_idx (Tell)"}),
+            value<-1>("network-threads", &numThreads, tag::ignore_short<true>{}),
+            value<-1>("transport", &transport, tag::description{"tcp, unix (Unix domain socket) or shm (shared memory, same host only)"}),
+            value<-1>("event-loops", &eventLoops, tag::description{"Number of event loops, each accepts on the port with SO_REUSEPORT and serves its connections on its own thread"}),
+            value<-1>("max-in-flight", &maxInFlight, tag::description{"Number of requests a connection executes concurrently"}),
+            value<-1>("rf-workers", &rfWorkers, tag::description{"Number of threads running RF1/RF2 (Kudu)"}),
+            value<-1>("group-commit-us", &groupCommitWindow, tag::description{"Merge RF1/RF2 arriving within this many microseconds into one transaction, 0 disables it (Tell)"}),
+            value<-1>("group-commit-max", &groupCommitSize, tag::description{"Maximum number of requests merged into one transaction (Tell)"}),
+            value<-1>("admission-latency-us", &admissionLatency, tag::description{"Limit the transactions of all connections so their mean latency stays below this many microseconds, 0 disables admission control"}),
+            value<-1>("admission-abort-percent", &admissionAbortPercent, tag::description{"Percentage of aborted transactions above which admission control lowers the limit"}),
+            value<-1>("admission-max", &admissionMax, tag::description{"Maximum number of transactions admission control lets run at once"}),
+            value<-1>("rf-max-attempts", &retryPolicy.maxAttempts, tag::description{"Number of times a conflicting RF1/RF2 is run before giving up"}),
+            value<-1>("rf-backoff-us", &backoff, tag::description{"Backoff in microseconds before the first retry, doubles with every retry"}),
+            value<-1>("rf-backoff-max-us", &maxBackoff, tag::description{"Maximum backoff in microseconds between retries"}),
+            value<-1>("stats-interval", &statsInterval, tag::description{"Seconds between logging RF1/RF2 statistics, 0 disables them"}),
+            value<-1>("update-dir", &updateDir, tag::description{"Load the update files of this directory, so clients can send RF1 batches by reference"})
             );
     try {
         parse(opts, argc, argv);
@@ -80,8 +223,39 @@ int main(int argc, const char** argv) {
         print_help(std::cout, opts);
         return 1;
     }
-    if (useKudu && partitions == -1) {
-        std::cerr << "Number of partitions needs to be set" << std::endl;
+    if (useKudu && partitions == -1 && hashBuckets.empty()) {
+        std::cerr << "Number of partitions or hash buckets needs to be set" << std::endl;
+        return 1;
+    }
+    tpch::SchemaOptions schemaOptions;
+    schemaOptions.partitions = std::max(partitions, 1);
+    schemaOptions.routedLoad = routedLoad;
+    schemaOptions.naturalKeys = naturalKeys;
+    schemaOptions.compactTypes = compactTypes;
+    retryPolicy.maxAttempts = std::max(retryPolicy.maxAttempts, 1u);
+    rfWorkers = std::max(rfWorkers, size_t(1));
+    retryPolicy.baseBackoff = std::chrono::microseconds(backoff);
+    retryPolicy.maxBackoff = std::chrono::microseconds(maxBackoff);
+    try {
+        parseHashBuckets(hashBuckets, schemaOptions);
+    } catch (std::exception& e) {
+        std::cerr << "Invalid hash buckets: " << e.what() << std::endl;
+        return 1;
+    }
+    try {
+        parseIndexes(indexes, schemaOptions);
+    } catch (std::exception& e) {
+        std::cerr << "Invalid indexes: " << e.what() << std::endl;
+        return 1;
+    }
+    // the router only knows the range partitions, a batch for one range
+    // would still go to every hash bucket of it
+    bool hashed = schemaOptions.hashBuckets > 1;
+    for (auto& table : schemaOptions.tableHashBuckets) {
+        hashed = hashed || table.second > 1;
+    }
+    if (routedLoad && hashed) {
+        std::cerr << "Routed load cannot be used with hash buckets" << std::endl;
         return 1;
     }
     if (help) {
@@ -93,64 +267,83 @@ int main(int argc, const char** argv) {
 
     crossbow::logger::logger->config.level = crossbow::logger::logLevelFromString(logLevel);
     try {
-        io_service service;
-        boost::asio::io_service::work work(service);
-        ip::tcp::acceptor a(service);
-        boost::asio::ip::tcp::acceptor::reuse_address option(true);
-        ip::tcp::resolver resolver(service);
-        ip::tcp::resolver::iterator iter;
-        if (host == "") {
-            iter = resolver.resolve(ip::tcp::resolver::query(port));
-        } else {
-            iter = resolver.resolve(ip::tcp::resolver::query(host, port));
+        // connections never move between loops, so a loop needs no locking
+        // and the protocol handling scales with the number of loops
+        auto transportType = tpch::parseTransport(transport);
+        std::vector<std::unique_ptr<EventLoop>> loops;
+        for (size_t i = 0; i < std::max(eventLoops, size_t(1)); ++i) {
+            loops.emplace_back(new EventLoop());
         }
-        ip::tcp::resolver::iterator end;
-        for (; iter != end; ++iter) {
-            boost::system::error_code err;
-            auto endpoint = iter->endpoint();
-            auto protocol = iter->endpoint().protocol();
-            a.open(protocol);
-            a.set_option(option);
-            a.bind(endpoint, err);
-            if (err) {
-                a.close();
-                LOG_WARN("Bind attempt failed " + err.message());
-                continue;
+        for (auto& loop : loops) {
+            if (transportType == tpch::TransportType::TCP) {
+                loop->listener = tpch::listen(loop->service, transportType, host, port, loops.size() > 1);
+                loop->services.emplace_back(&loop->service);
+            } else {
+                // a socket path can only be bound once
+                auto& first = loops.front();
+                if (!first->listener)
+                    first->listener = tpch::listen(first->service, transportType, host, port, false);
+                first->services.emplace_back(&loop->service);
             }
-            break;
         }
-        if (!a.is_open()) {
-            LOG_ERROR("Could not bind");
-            return 1;
+        auto& service = loops.front()->service;
+        boost::asio::steady_timer statsTimer(service);
+
+        // loaded once and shared read-only by all connections
+        std::shared_ptr<const tpch::UpdateSets> updateSets;
+        if (!updateDir.empty()) {
+            updateSets = std::make_shared<tpch::UpdateSets>(updateDir);
+            LOG_INFO("Loaded %1% orders of %2% update files", updateSets->numOrders(), updateSets->size());
+        }
+        std::shared_ptr<tpch::AdmissionController> admission;
+        if (admissionLatency > 0) {
+            admission = std::make_shared<tpch::AdmissionController>(admissionMax,
+                    std::chrono::microseconds(admissionLatency), admissionAbortPercent / 100.0);
         }
-        a.listen();
 
         // we do not need to delete this object, it will delete itself
         if (useKudu) {
 #ifdef USE_KUDU
-            tpch::DBGenerator<tpch::KuduClient, tpch::KuduFiber> generator;
-            auto client = tpch::Connection<tpch::KuduClient, tpch::KuduFiber>::getClient(
+            tpch::ServerContext<tpch::KuduClient, tpch::KuduFiber> context;
+            context.client = tpch::Connection<tpch::KuduClient, tpch::KuduFiber>::getClient(
                     storageNodes, commitManager, numThreads);
-            accept(service, a, client, generator, partitions);
-            std::vector<std::thread> threads;
-            for (unsigned i = 0; i < numThreads; ++i) {
-                threads.emplace_back([&service](){
-                        service.run();
-                });
-            }
-            for (auto& t : threads) {
-                t.join();
-            }
+            context.schemaOptions = schemaOptions;
+            context.retryPolicy = retryPolicy;
+            context.maxInFlight = maxInFlight;
+            context.workers = std::make_shared<tpch::KuduWorkerPool>(context.client, rfWorkers);
+            context.updateSets = updateSets;
+            context.admission = admission;
+            context.stop = [&loops]() {
+                stopAll(loops);
+            };
+            if (statsInterval > 0)
+                logStats(statsTimer, context.stats, std::chrono::seconds(statsInterval), admission.get());
+            // the Kudu connections synchronize on strands
+            run(loops, numThreads, context);
 #else
                 std::cerr << "Code was not compiled for Kudu\n";
                 return 1;
 #endif
         } else {
-            tpch::DBGenerator<tpch::TellClient, tpch::TellFiber> generator;
-            auto client = tpch::Connection<tpch::TellClient, tpch::TellFiber>::getClient(
+            tpch::ServerContext<tpch::TellClient, tpch::TellFiber> context;
+            context.client = tpch::Connection<tpch::TellClient, tpch::TellFiber>::getClient(
                     storageNodes, commitManager, numThreads);
-            accept(service, a, client, generator, partitions);
-            service.run();
+            context.schemaOptions = schemaOptions;
+            context.retryPolicy = retryPolicy;
+            context.maxInFlight = maxInFlight;
+            context.updateSets = updateSets;
+            context.admission = admission;
+            context.stop = [&loops]() {
+                stopAll(loops);
+            };
+            if (groupCommitWindow > 0) {
+                context.groupCommitter = std::make_shared<tpch::GroupCommitter>(context.client, service,
+                        context.tables, context.schemaOptions, context.retryPolicy, context.stats,
+                        std::chrono::microseconds(groupCommitWindow), groupCommitSize, admission.get());
+            }
+            if (statsInterval > 0)
+                logStats(statsTimer, context.stats, std::chrono::seconds(statsInterval), admission.get());
+            run(loops, 1, context);
         }
     } catch (std::exception& e) {
         std::cerr << e.what() << std::endl;